@@ -10,6 +10,8 @@
 #include "web.h"
 #include "shell.h"
 #include "commands.h"
+#include "engine/sched.h"
+#include "engine/core1.h"
 
 unsigned long startTime;   // Para calcular uptime
 
@@ -48,14 +50,28 @@ void setup() {
 }
 
 void loop() {
+  sched_loop_mark();      // latencia entre pasadas (comando sched)
   server.handleClient();  // Procesa peticiones web
 
+  // Con un script MiniC en primer plano la entrada espera a que acabe;
+  // solo se atiende Ctrl-C para interrumpirlo
+  static int fg_prev = 0;
+  int fg = sched_foreground();
+  if (fg && Serial.peek() == 3) {
+    Serial.read();
+    sched_kill(fg);
+    Serial.println("^C");
+    fg = 0;
+  }
+  if (fg_prev && !fg) printPrompt();
+  fg_prev = fg;
+
   // Procesar comandos vía serial o web
   static char cmdBuffer[MAX_CMD_LEN];
   static int bufPos = 0;
   static uint32_t t = 0;
   // Entrada vía serial
-  if (Serial.available()) {
+  if (!fg && Serial.available()) {
     char c = Serial.read();
     // Echo local
     Serial.print(c);
@@ -66,7 +82,8 @@ void loop() {
         executeCommand(cmdBuffer);
       }
       bufPos = 0;
-      printPrompt();
+      fg = fg_prev = sched_foreground();
+      if (!fg) printPrompt();
     } else if (c == 127 || c == '\b') {  // Backspace
       if (bufPos > 0) {
         bufPos--;
@@ -77,7 +94,7 @@ void loop() {
     }
   }
   // Entrada vía web
-  if (newCommandFromWeb && inputBuffer.length() > 0) {
+  if (!fg && newCommandFromWeb && inputBuffer.length() > 0) {
     // Copiar con terminación segura
     size_t n = inputBuffer.length();
     if (n >= MAX_CMD_LEN) n = MAX_CMD_LEN - 1;
@@ -92,11 +109,22 @@ void loop() {
     isWebCommand = true;
     executeCommand(cmdBuffer);
     isWebCommand = false;
+    fg = fg_prev = sched_foreground();
     newCommandFromWeb = false;
     inputBuffer = "";
   }
+  // Un turno de la siguiente tarea MiniC (primer plano o bg) y la
+  // salida / nativas pendientes del programa del núcleo 1
+  sched_run();
+  core1_poll();
+
   if (millis() - t > 1000) {
     flushFS();
     t = millis();
   }
 }
+
+// Núcleo 1: programas MiniC lanzados con "minic -c1"
+void loop1() {
+  core1_loop();
+}
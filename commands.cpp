@@ -3,6 +3,8 @@
 #include "fs.h"
 #include "wifi.h"
 #include "engine/mini_c.c"
+#include "engine/sched.c"
+#include "engine/core1.c"
 #include "editor.h"
 
 extern unsigned long startTime;  // Para calcular uptime
@@ -32,6 +34,10 @@ Command commands[] = {
   { "reboot", cmd_reboot, "Reinicia el Pico" },
   { "neofetch", cmd_neofetch, "Muestra info del sistema con estilo neofetch" },
   { "minic", cmd_minic, "Intérprete minimalista para lenguaje C" },
+  { "bg", cmd_bg, "bg archivo.mc - ejecuta un script MiniC en segundo plano" },
+  { "ps", cmd_ps, "Lista las tareas MiniC y su tiempo de CPU" },
+  { "kill", cmd_kill, "kill id - termina una tarea MiniC" },
+  { "sched", cmd_sched, "Turnos del planificador MiniC y latencia del loop" },
   { "nano", cmd_nano, "Editor de texto estilo nano" },
   { "about", cmd_about, "Acerca del sistema." },
   { nullptr, nullptr, nullptr }  // fin de lista
@@ -568,15 +574,119 @@ void cmd_neofetch(int argc, char* argv[]) {
   }
   outPrintln();
 }
+// Lee un fuente MiniC de LittleFS en un buffer malloc terminado en '\0'.
+// NULL (con el error ya mostrado) si no existe, está vacío o no cabe.
+static char* minic_read_source(const char* filename, size_t* len) {
+  // Intentamos abrir el archivo
+  File file = LittleFS.open(filename, "r");
+  if (!file) {
+    outPrint("Error: No se pudo abrir el archivo: ");
+    outPrintln(filename);
+    return NULL;
+  }
+
+  // Calculamos tamaño
+  size_t size = file.size();
+  if (size == 0) {
+    outPrintln("El archivo está vacío");
+    file.close();
+    return NULL;
+  }
+  if (size > 4096) {  // límite razonable para evitar desbordamientos
+    outPrintln("Error: Programa demasiado grande (>4KB)");
+    file.close();
+    return NULL;
+  }
+
+  // Reservamos buffer
+  char* buffer = (char*)malloc(size + 1);
+  if (!buffer) {
+    outPrintln("Error: No hay suficiente memoria");
+    file.close();
+    return NULL;
+  }
+
+  // Leemos todo el contenido
+  *len = file.readBytes(buffer, size);
+  buffer[*len] = '\0';  // terminador nulo importante!!
+  file.close();
+  return buffer;
+}
+
+// bytecode precompilado junto al fuente: prog.mc -> prog.mcb
+static void minic_mcb_path(const char* filename, char* out, size_t size) {
+  size_t n = strlen(filename);
+  bool has_mc = n >= 3 && strcmp(filename + n - 3, ".mc") == 0;
+  snprintf(out, size, has_mc ? "%sb" : "%s.mcb", filename);
+}
+
+static void minic_start_core1(const char* name, MinicProgram* p, uint8_t profile) {
+  int id = core1_start(name, p, profile);
+  if (id < 0) outPrintln("Error: el núcleo 1 ya está ejecutando un programa");
+  else outPrintf("[%d] %s en el núcleo 1\n", id, name);
+}
+
 void cmd_minic(int argc, char** argv) {
   if (argc < 2) {
     outPrintln("Uso:");
     outPrintln("  minic \"código aquí\"                  → ejecuta código directamente");
     outPrintln("  minic file nombre_archivo.mini         → ejecuta desde archivo en LittleFS");
+    outPrintln("  minic lex nombre_archivo.mini          → benchmark del lexer (tokens/s)");
     outPrintln("  minic help                             → muestra esta ayuda");
+    outPrintln("Opciones (antes del modo):");
+    outPrintln("  -O0                                    → sin optimizaciones (peephole, inline, llamadas de cola)");
+    outPrintln("  -i                                     → informa de las llamadas expandidas en línea (sin caché)");
+    outPrintln("  -l                                     → compila solo las funciones que se llaman");
+    outPrintln("  -nc                                    → ignora la caché de bytecode (.mcb)");
+    outPrintln("  -q N                                   → cuota de CPU del script (N %)");
+    outPrintln("  -c1                                    → ejecuta en el núcleo 1 (no bloquea la shell)");
+    outPrintln("  -p                                     → perfil por opcode y función (/sys/<script>.prof)");
+    outPrintln("  -s                                     → perfil por línea, por muestreo (/sys/<script>.prof)");
+    outPrintln("El script corre por turnos desde loop(); Ctrl-C lo interrumpe.");
     return;
   }
 
+  // Opciones: -O0 desactiva las optimizaciones (para medir su efecto), -i
+  // lista las llamadas expandidas en línea al compilar (por eso sin caché),
+  // -l compila perezosamente y quita las funciones a las que nada llama,
+  // -nc compila siempre desde el fuente sin leer ni escribir la caché,
+  // -q N limita el script al N % de la CPU, -c1 lo ejecuta en el núcleo 1,
+  // -p lo perfila (exacto), -s lo perfila por muestreo
+  minic_opt = 1;
+  minic_inline_report = 0;
+  minic_lazy = 0;
+  bool use_cache = true;
+  bool on_core1 = false;
+  uint8_t profile = PROF_OFF;
+  uint8_t quota = 100;
+  while (argc > 1 && argv[1][0] == '-') {
+    if (strcmp(argv[1], "-O0") == 0) minic_opt = 0;
+    else if (strcmp(argv[1], "-l") == 0) minic_lazy = 1;
+    else if (strcmp(argv[1], "-i") == 0) {
+      minic_inline_report = 1;
+      use_cache = false;
+    }
+    else if (strcmp(argv[1], "-nc") == 0) use_cache = false;
+    else if (strcmp(argv[1], "-c1") == 0) on_core1 = true;
+    else if (strcmp(argv[1], "-p") == 0) profile = PROF_EXACT;
+    else if (strcmp(argv[1], "-s") == 0) profile = PROF_SAMPLE;
+    else if (strcmp(argv[1], "-q") == 0 && argc > 2) {
+      quota = atoi(argv[2]);
+      argc--;
+      argv++;
+    }
+    argc--;
+    argv++;
+  }
+  if (argc < 2) {
+    cmd_minic(1, NULL);
+    return;
+  }
+#if !MINIC_PROFILE
+  if (profile) outPrintln("Aviso: perfilador no compilado (define MINIC_PROFILE 1 en engine/vm.h)");
+#endif
+
+
   // Ayuda explícita
   if (strcmp(argv[1], "help") == 0) {
     cmd_minic(1, NULL);  // recursión ligera solo para mostrar ayuda
@@ -602,10 +712,14 @@ void cmd_minic(int argc, char** argv) {
     outPrintln(code);
     outPrintln("----------------------------------------");
 
-    minic_run(code);
-
-    outPrintln("----------------------------------------");
-    outPrintln("[MiniC finalizado]");
+    // corre en primer plano por turnos (o en el núcleo 1); el final lo
+    // muestra sched.c (core1.c)
+    MinicProgram* p = minic_compile(code);
+    if (p && on_core1) minic_start_core1("minic", p, profile);
+    else if (!p || sched_spawn("minic", p, quota, 1, profile) < 0) {
+      outPrintln("----------------------------------------");
+      outPrintln("[MiniC finalizado con errores]");
+    }
     return;
   }
 
@@ -614,8 +728,7 @@ void cmd_minic(int argc, char** argv) {
   // -------------------------------------------------------
   if (argc >= 3 && strcmp(argv[1], "file") == 0) {
     const char* filename = argv[2];
-
-    // Intentamos abrir el archivo
+    // el fuente no se carga entero: el lexer lo va leyendo del archivo
     File file = LittleFS.open(filename, "r");
     if (!file) {
       outPrint("Error: No se pudo abrir el archivo: ");
@@ -623,45 +736,48 @@ void cmd_minic(int argc, char** argv) {
       return;
     }
 
-    // Calculamos tamaño
-    size_t size = file.size();
-    if (size == 0) {
-      outPrintln("El archivo está vacío");
-      file.close();
-      return;
-    }
-    if (size > 4096) {  // límite razonable para evitar desbordamientos
-      outPrintln("Error: Programa demasiado grande (>4KB)");
-      file.close();
-      return;
-    }
-
-    // Reservamos buffer
-    char* buffer = (char*)malloc(size + 1);
-    if (!buffer) {
-      outPrintln("Error: No hay suficiente memoria");
-      file.close();
-      return;
-    }
-
-    // Leemos todo el contenido
-    size_t read = file.readBytes(buffer, size);
-    buffer[read] = '\0';  // terminador nulo importante!!
-    file.close();
-
     outPrint("Ejecutando desde archivo: ");
     outPrintln(filename);
     outPrint("Tamaño: ");
-    outPrint(String(read));
+    outPrint(String(file.size()));
     outPrintln(" bytes");
     outPrintln("----------------------------------------");
 
-    minic_run(buffer);
+    char mcb_path[96];
+    minic_mcb_path(filename, mcb_path, sizeof(mcb_path));
+    int hit;
+    MinicProgram* p = minic_open_file(file, use_cache ? mcb_path : NULL, &hit);
+    file.close();
+    if (p && hit) outPrintln("(bytecode desde caché)");
+    if (p && on_core1) minic_start_core1(filename, p, profile);
+    else if (!p || sched_spawn(filename, p, quota, 1, profile) < 0) {
+      outPrintln("----------------------------------------");
+      outPrintln("[MiniC finalizado con errores]");
+    }
+    return;
+  }
 
-    outPrintln("----------------------------------------");
-    outPrintln("[MiniC finalizado]");
+  // -------------------------------------------------------
+  // Modo 3: benchmark del lexer sobre un archivo
+  // -------------------------------------------------------
+  if (argc >= 3 && strcmp(argv[1], "lex") == 0) {
+    size_t len;
+    char* buffer = minic_read_source(argv[2], &len);
+    if (!buffer) return;
 
+    // se repite el fuente entero hasta acumular ~200 ms
+    uint32_t tokens = 0, passes = 0;
+    uint32_t t0 = micros(), elapsed;
+    do {
+      tokens += minic_lex_count(buffer);
+      passes++;
+      elapsed = micros() - t0;
+    } while (elapsed < 200000);
     free(buffer);
+
+    outPrintf("Lexer: %lu tokens x %lu pasadas en %lu us\n",
+              (unsigned long)(tokens / passes), (unsigned long)passes, (unsigned long)elapsed);
+    outPrintf("Throughput: %lu tokens/s\n", (unsigned long)((uint64_t)tokens * 1000000 / elapsed));
     return;
   }
 
@@ -669,6 +785,82 @@ void cmd_minic(int argc, char** argv) {
   outPrintln("Formato no reconocido.");
   outPrintln("Usa: minic help  para ver las opciones.");
 }
+// =============================================
+//  Tareas MiniC en segundo plano (engine/sched.c)
+// =============================================
+void cmd_bg(int argc, char* argv[]) {
+  uint8_t quota = 100;
+  if (argc > 3 && strcmp(argv[1], "-q") == 0) {
+    quota = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc < 2) {
+    outPrintln("Uso: bg [-q cuota%] archivo.mc");
+    return;
+  }
+  File file = LittleFS.open(argv[1], "r");
+  if (!file) {
+    outPrint("Error: No se pudo abrir el archivo: ");
+    outPrintln(argv[1]);
+    return;
+  }
+  char mcb_path[96];
+  minic_mcb_path(argv[1], mcb_path, sizeof(mcb_path));
+  minic_opt = 1;
+  minic_inline_report = 0;
+  minic_lazy = 0;
+  int hit;
+  MinicProgram* p = minic_open_file(file, mcb_path, &hit);
+  file.close();
+  if (!p) return;  // el error de compilación ya se mostró
+
+  int id = sched_spawn(argv[1], p, quota, 0, 0);
+  if (id < 0) outPrintf("Error: máximo %d tareas\n", MAX_TASKS);
+  else outPrintf("[%d] %s\n", id, argv[1]);
+}
+
+void cmd_ps(int argc, char* argv[]) {
+  outPrintln("  ID  ESTADO  CPU(ms)  %CPU  CUOTA  TURNOS  NOMBRE");
+  for (int i = 0; i < MAX_TASKS; i++) {
+    const Task* t = &tasks[i];
+    if (t->state == TASK_FREE) continue;
+    uint32_t up_ms = millis() - t->start_ms;
+    uint32_t pct = up_ms ? (uint32_t)(t->cpu_us / 10 / up_ms) : 0;
+    outPrintf("%4d  %-6s  %7lu  %3lu%%  %4u%%  %6lu  %s%s\n", t->id,
+              t->state == TASK_SLEEP ? "sleep" : "run",
+              (unsigned long)(t->cpu_us / 1000), (unsigned long)pct, t->quota,
+              (unsigned long)t->slices, t->name, t->fg ? " (fg)" : "");
+  }
+  const char* name;
+  uint32_t cpu_ms;
+  int id = core1_job(&name, &cpu_ms);
+  if (id) outPrintf("%4d  %-6s  %7lu  %4s  %5s  %6s  %s\n", id, "core1", (unsigned long)cpu_ms, "-", "-", "-", name);
+}
+
+void cmd_sched(int argc, char* argv[]) {
+  if (argc >= 4 && strcmp(argv[1], "slice") == 0) {
+    sched_slice_ticks = atol(argv[2]) > 0 ? atol(argv[2]) : TASK_SLICE;
+    sched_slice_us = atol(argv[3]) > 0 ? atol(argv[3]) : TASK_SLICE_US;
+  } else if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+    loop_lat_max_us = 0;
+  } else if (argc >= 2) {
+    outPrintln("Uso: sched [slice ticks us | reset]");
+    return;
+  }
+  outPrintf("Turno: %ld ticks / %lu us\n", (long)sched_slice_ticks, (unsigned long)sched_slice_us);
+  outPrintf("Latencia máx. de loop(): %lu us\n", (unsigned long)loop_lat_max_us);
+}
+
+void cmd_kill(int argc, char* argv[]) {
+  if (argc < 2) {
+    outPrintln("Uso: kill id");
+    return;
+  }
+  int id = atoi(argv[1]);
+  if (sched_kill(id) < 0 && core1_kill(id) < 0) outPrintln("No existe esa tarea");
+}
+
 //static NanoLite editor;
 static Editor editor;
 
@@ -37,5 +37,9 @@ void cmd_httpget(int argc, char* argv[]);
 void cmd_reboot(int argc, char* argv[]);
 void cmd_neofetch(int argc, char* argv[]);
 void cmd_minic(int argc, char* argv[]);
+void cmd_bg(int argc, char* argv[]);
+void cmd_ps(int argc, char* argv[]);
+void cmd_kill(int argc, char* argv[]);
+void cmd_sched(int argc, char* argv[]);
 void cmd_nano(int argc, char* argv[]);
 void cmd_about(int argc, char* argv[]);
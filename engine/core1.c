@@ -0,0 +1,188 @@
+#include "core1.h"
+#include "spsc.h"
+#include "../io.h"
+#if !defined(ARDUINO_ARCH_RP2040)
+#include <thread>
+#endif
+
+// Se compila dentro de commands.cpp tras sched.c (usa vm_exec() y los ids
+// de tarea directamente).
+
+typedef struct {
+  MinicProgram *prog;
+  MiniCVM *inst;
+} Core1Job;
+
+typedef struct {
+  uint8_t native;   // índice en native_table
+  uint8_t argc;
+  int32_t args[MAX_PARAM];
+} Core1Call;
+
+static Spsc<Core1Job, 2> job_q;       // 0 -> 1
+static Spsc<Core1Call, 2> call_q;     // 1 -> 0: nativa pendiente
+static Spsc<int32_t, 2> ret_q;        // 0 -> 1: su resultado
+static Spsc<char, CORE1_OUT> out_q;   // 1 -> 0: consola
+static Spsc<int8_t, 2> done_q;        // 1 -> 0: VM_HALTED, VM_FAULTED o -1 (kill)
+
+static std::atomic<bool> core1_stop{false};
+static std::atomic<uint32_t> core1_us{0};   // solo lo escribe el núcleo 1
+
+// trabajo en curso; solo lo toca el núcleo 0
+static Core1Job job;
+static int job_id;
+static uint8_t job_web;
+static char job_name[TASK_NAME];
+
+static inline void core1_wait(void){
+#if defined(ARDUINO_ARCH_RP2040)
+  tight_loop_contents();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// ---------- lado del núcleo 1 ----------
+void core1_puts(const char *s){
+  for(; *s; s++)
+    while(!out_q.push(*s)) core1_wait();
+}
+
+// Nativa que debe correr en el núcleo 0: se encola y se espera el
+// resultado (la instancia queda quieta mientras, así que el núcleo 0
+// puede usar sus strings)
+int32_t core1_native(int native, int32_t *args, int argc){
+  Core1Call c;
+  c.native = (uint8_t)native;
+  c.argc = (uint8_t)argc;
+  memcpy(c.args, args, argc * sizeof(int32_t));
+  while(!call_q.push(c)) core1_wait();
+  int32_t r;
+  while(!ret_q.pop(r)) core1_wait();
+  return r;
+}
+
+// Hasta OP_HALT, un error o kill (-1)
+static int core1_exec(MiniCVM *v){
+  int st;
+  do {
+    uint32_t t0 = micros();
+    st = vm_exec(v, CORE1_CHUNK);
+    core1_us.store(core1_us.load(std::memory_order_relaxed) + (micros() - t0), std::memory_order_relaxed);
+    if(core1_stop.load(std::memory_order_relaxed)) return -1;
+  } while(st != VM_HALTED && st != VM_FAULTED);
+  return st;
+}
+
+void core1_loop(void){
+  Core1Job j;
+  if(!job_q.pop(j)){
+    core1_wait();
+    return;
+  }
+  MiniCVM *v = j.inst;
+  int st = core1_exec(v);   // globals
+  if(st == VM_HALTED){
+    int fi = minic_func(j.prog, "main");
+    v->sp = 0;
+    if(fi >= 0) st = vm_enter(v, fi, NULL, 0) < 0 ? VM_FAULTED : core1_exec(v);
+  }
+  while(!done_q.push((int8_t)st)) core1_wait();
+}
+
+#if !defined(ARDUINO_ARCH_RP2040)
+void core1_launch(void){
+  std::thread([]{
+    minic_core_id = 1;
+    for(;;) core1_loop();
+  }).detach();
+}
+#endif
+
+// ---------- lado del núcleo 0 ----------
+int core1_start(const char *name, MinicProgram *p, uint8_t profile){
+  MiniCVM *v = job_id ? NULL : vm_alloc(p);
+  if(!v){
+    minic_program_free(p);
+    return -1;
+  }
+  v->core1 = 1;
+#if MINIC_PROFILE
+  if(profile && minic_profile_start(v, profile == PROF_SAMPLE ? PROF_SAMPLE_US : 0) < 0)
+    outPrintln("Aviso: no se puede perfilar (¿otro muestreo en curso?)");
+#endif
+  job.prog = p;
+  job.inst = v;
+  job_id = next_task_id++;
+  job_web = isWebCommand;
+  strncpy(job_name, name, TASK_NAME - 1);
+  job_name[TASK_NAME - 1] = '\0';
+  core1_stop.store(false);
+  core1_us.store(0);
+  job_q.push(job);
+  return job_id;
+}
+
+int core1_kill(int id){
+  if(!job_id || id != job_id) return -1;
+  core1_stop.store(true);   // el núcleo 1 lo ve en el siguiente tramo
+  return 0;
+}
+
+int core1_job(const char **name, uint32_t *cpu_ms){
+  if(job_id){
+    *name = job_name;
+    *cpu_ms = core1_us.load(std::memory_order_relaxed) / 1000;
+  }
+  return job_id;
+}
+
+static void core1_drain(int max){
+  char buf[65], c;
+  int n = 0;
+  while(max-- > 0 && out_q.pop(c)){
+    buf[n++] = c;
+    if(n == 64){
+      buf[n] = '\0';
+      outPrint(buf);
+      n = 0;
+    }
+  }
+  buf[n] = '\0';
+  if(n) outPrint(buf);
+}
+
+// Devuelve VM_HALTED, VM_FAULTED o -1 (kill) en la llamada en que acaba
+// el trabajo; CORE1_BUSY en las demás
+int core1_poll(void){
+  if(!job_id) return CORE1_BUSY;
+  bool web = isWebCommand;   // la salida va a la terminal que lo lanzó
+  isWebCommand = job_web;
+  core1_drain(64);
+
+  Core1Call c;
+  if(call_q.pop(c)){
+    // la nativa ve las strings de la instancia del núcleo 1
+    MiniCVM *caller = minic_set_vm(job.inst);
+    int32_t r = native_table[c.native].fn(c.args, c.argc);
+    minic_set_vm(caller);
+    ret_q.push(r);
+  }
+
+  int8_t st;
+  int r = CORE1_BUSY;
+  if(done_q.pop(st)){
+    core1_drain(CORE1_OUT);   // todo lo escrito antes del fin ya es visible
+    outPrintf("[%d] %s (núcleo 1): %s\n", job_id, job_name,
+              st == VM_HALTED ? "terminada" : st < 0 ? "interrumpida" : "terminada con errores");
+#if MINIC_PROFILE
+    if(job.inst->prof) task_profile_report(job.inst, job_name);
+#endif
+    minic_vm_free(job.inst);
+    minic_program_free(job.prog);
+    job_id = 0;
+    r = st;
+  }
+  isWebCommand = web;
+  return r;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "vm.h"
+
+// -------- MiniC en el núcleo 1 --------
+// Un programa a la vez corre entero en el núcleo 1 (loop1()); el núcleo 0
+// sigue con la shell y el servidor web. Todo pasa por colas SPSC:
+//   núcleo 0 -> 1: el trabajo a ejecutar y los resultados de las nativas
+//   núcleo 1 -> 0: la salida de consola, las nativas que deben correr en
+//                  el núcleo 0 (NativeEntry.core0) y el fin del trabajo
+// core1_poll() atiende el lado del núcleo 0 desde loop().
+#define CORE1_CHUNK   4096   // ticks entre consultas de kill
+#define CORE1_OUT     512    // bytes de salida de consola en vuelo
+#define CORE1_BUSY    -2     // core1_poll(): el trabajo sigue (o no hay)
+
+int core1_start(const char *name, MinicProgram *p, uint8_t profile);   // id; -1 (p liberado) si ocupado
+int core1_kill(int id);                               // 0 = ok, -1 si no es el del núcleo 1
+int core1_job(const char **name, uint32_t *cpu_ms);   // id del trabajo en curso; 0 = libre
+int core1_poll(void);                                 // núcleo 0, desde loop(); estado al acabar
+void core1_loop(void);                                // núcleo 1, desde loop1()
+#if !defined(ARDUINO_ARCH_RP2040)
+void core1_launch(void);                              // Linux: un hilo hace de núcleo 1
+#endif
+
+// usadas por vm_exec() cuando la instancia corre en el núcleo 1
+int32_t core1_native(int native, int32_t *args, int argc);
+void core1_puts(const char *s);
@@ -2,82 +2,518 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <setjmp.h>
 #include "vm.h"
 #include "sys.h"
+#include "core1.h"
 
 // ---------- ESTADO GLOBAL ----------
 Lexer lx;
-MiniCVM vm;
+MiniCVM *vm_core[2];          // instancia en ejecución en cada núcleo
+#if !defined(ARDUINO_ARCH_RP2040)
+thread_local int minic_core_id;
+#endif
+static MinicProgram *prog;    // programa que se está compilando o cargando
+static Compiler *cc;          // solo durante la compilación
+static jmp_buf compile_fail;  // syntax() vuelve aquí
+
+// Optimizaciones del compilador: peephole(), expansión en línea y
+// llamadas de cola. minic_opt = 0 las desactiva para medir.
+int minic_opt = 1;
+int minic_inline_report = 0;   // informa de cada llamada expandida en línea
+// Compilación perezosa: el cuerpo de cada función de nivel superior se
+// salta al declararla y solo se compila si algo la llama; al final se
+// quitan las funciones inalcanzables desde el nivel superior y main().
+// Las que no queden no existen para minic_func().
+int minic_lazy = 0;
+
+// Bucle en compilación: los break/continue pendientes forman una lista
+// enlazada a través de sus propios operandos (0 = fin de lista). Un
+// switch también abre uno (start = -1) para sus break; sus continue son
+// del bucle que lo contiene.
+typedef struct LoopCtx {
+  int start;
+  int breaks;
+  int conts;
+  struct LoopCtx *prev;
+} LoopCtx;
+static LoopCtx *cur_loop = NULL;
+
+// Identificador ya consumido por assign_or_expr_stmt(); lo retoma unary().
+static char pend_id[32];
+static uint32_t pend_hash;
+
+// ---------- ARENA ----------
+static void syntax(const char *msg);
+
+static void *arena_alloc(size_t n){
+  n = ARENA_ALIGN(n);   // alineado a puntero (VmString, Function)
+  ArenaChunk *c = prog->arena.head;
+  if(!c || c->used + n > c->size){
+    size_t size = n > ARENA_CHUNK ? n : ARENA_CHUNK;
+    c = (ArenaChunk *)malloc(sizeof(ArenaChunk) + size);
+    if(!c) syntax("out of memory");
+    c->next = prog->arena.head;
+    c->size = size;
+    c->used = 0;
+    prog->arena.head = c;
+    prog->arena.total += sizeof(ArenaChunk) + size;
+  }
+  void *p = (uint8_t *)(c + 1) + c->used;
+  c->used += n;
+  return p;
+}
+
+// Amplía el bloque `p` (old_n bytes) a new_n: en el sitio si es lo último
+// que se pidió al bloque actual y cabe; si no, copia a uno nuevo (el viejo
+// se recupera al liberar la arena).
+static void *arena_grow(void *p, size_t old_n, size_t new_n){
+  ArenaChunk *c = prog->arena.head;
+  old_n = ARENA_ALIGN(old_n);
+  new_n = ARENA_ALIGN(new_n);
+  if(p && c && (uint8_t *)p + old_n == (uint8_t *)(c + 1) + c->used &&
+     c->used - old_n + new_n <= c->size){
+    c->used += new_n - old_n;
+    return p;
+  }
+  void *q = arena_alloc(new_n);
+  if(p) memcpy(q, p, old_n);
+  return q;
+}
+
+static void arena_release(Arena *a){
+  while(a->head){
+    ArenaChunk *next = a->head->next;
+    free(a->head);
+    a->head = next;
+  }
+  a->total = 0;
+}
+
+// Segmento (code, funcs, string_pool) que crece al doble dentro de la
+// arena, empezando en `first` elementos; devuelve su nueva dirección
+static void *segment_reserve(void *seg, int *cap, int need, size_t elem,
+                             int first, int limit, const char *overflow){
+  if(need > limit) syntax(overflow);
+  if(need <= *cap) return seg;
+  int ncap = *cap ? *cap * 2 : first;
+  while(ncap < need) ncap *= 2;
+  if(ncap > limit) ncap = limit;
+  seg = arena_grow(seg, *cap * elem, ncap * elem);
+  *cap = ncap;
+  return seg;
+}
+
+// Handle del literal `str` en prog->string_pool; los repetidos comparten
+// entrada, así que dos literales iguales son el mismo handle
+static int intern(const char *str){
+  size_t len = strlen(str);
+  for(int i = 0; i < prog->string_count; i++)
+    if(prog->string_pool[i].len == len && !memcmp(prog->string_pool[i].ptr, str, len)) return i;
+  prog->string_pool = (VmString *)segment_reserve(prog->string_pool, &prog->string_cap, prog->string_count + 1,
+                                                 sizeof(VmString), 8, MAX_STR_POOL, "string pool overflow");
+  VmString *s = &prog->string_pool[prog->string_count];
+  s->ptr = (const char *)memcpy(arena_alloc(len + 1), str, len + 1);
+  s->len = len;
+  s->refs = 0;
+  s->owner = STR_NONE;
+  return prog->string_count++;
+}
 
 // ---------- EMISIÓN DE BYTECODE ----------
-static void emit(uint32_t op){ vm.code[vm.code_size++] = op; }
-static void emit_i(int32_t v){ vm.code[vm.code_size++] = (uint32_t)v; }
+// Código orientado a byte: opcode de 1 byte seguido de sus operandos en
+// little-endian (ver MINIC_OPCODES). Se leen byte a byte porque el M0+
+// no admite accesos desalineados.
+#define RD16(p) ((uint16_t)((p)[0] | ((p)[1] << 8)))
+#define RD32(p) ((uint32_t)((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((uint32_t)(p)[3] << 24)))
+
+static void emit(uint8_t b){
+  if(prog->code_size >= prog->code_cap)
+    prog->code = (uint8_t *)segment_reserve(prog->code, &prog->code_cap, prog->code_size + 1, 1,
+                                           256, MAX_CODE, "code overflow");
+  prog->code[prog->code_size++] = b;
+}
+static void emit_u16(uint16_t v){ emit(v & 0xFF); emit(v >> 8); }
+
+// Desde aquí el código es de la línea cc->line. Las entradas de código ya
+// descartado (code_size rebobinado) se quitan; una entrada en el mismo ip
+// que no llegó a tener código se reutiliza.
+static void line_mark(void){
+  int ip = prog->code_size, n = prog->line_count;
+  while(n && prog->lines[n - 1].ip > ip) n--;
+  prog->line_count = n;
+  LineEntry *last = n ? &prog->lines[n - 1] : NULL;
+  if(last && last->line == cc->line) return;
+  if(last && last->ip == ip){
+    if(n > 1 && last[-1].line == cc->line) prog->line_count--;   // vuelve a la anterior
+    else last->line = cc->line;
+    return;
+  }
+  prog->lines = (LineEntry *)segment_reserve(prog->lines, &prog->line_cap, n + 1, sizeof(LineEntry),
+                                             32, MAX_CODE, "line table overflow");
+  prog->lines[n].ip = ip;
+  prog->lines[n].line = cc->line;
+  prog->line_count++;
+}
+
+// Entrada de la tabla de líneas que contiene `ip` (búsqueda binaria); -1
+// si está antes de la primera
+static int line_entry(const MinicProgram *p, int ip){
+  int lo = 0, hi = p->line_count;   // primera con ip mayor
+  while(lo < hi){
+    int mid = (lo + hi) / 2;
+    if(p->lines[mid].ip <= ip) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo - 1;
+}
+
+int minic_line(const MinicProgram *p, int ip){
+  int e = line_entry(p, ip);
+  return e < 0 ? 0 : p->lines[e].line;
+}
+static void emit_i32(int32_t v){ emit_u16((uint32_t)v & 0xFFFF); emit_u16((uint32_t)v >> 16); }
+
+// constante entera con la codificación más corta que la representa
+static void emit_const(int32_t v){
+  if(v >= INT8_MIN && v <= INT8_MAX){ emit(OP_PUSH_I8); emit((uint8_t)v); }
+  else if(v >= INT16_MIN && v <= INT16_MAX){ emit(OP_PUSH_I16); emit_u16((uint16_t)v); }
+  else { emit(OP_PUSH_CONST); emit_i32(v); }
+}
 
 static int emit_jmp(OpCode op){
   emit(op);
-  int pos = vm.code_size;
-  emit_i(0);
+  int pos = prog->code_size;
+  emit_u16(0);
   return pos;
 }
 static void patch(int pos,int dst){
-	vm.code[pos] = dst; 
+	prog->code[pos] = dst & 0xFF;
+	prog->code[pos + 1] = dst >> 8;
+}
+
+// salto que se encadena a la lista `chain`; devuelve la nueva cabeza
+static int emit_jmp_chain(OpCode op, int chain){
+  int pos = emit_jmp(op);
+  patch(pos, chain);
+  return pos;
+}
+static void patch_chain(int chain, int dst){
+  while(chain){
+    int next = RD16(prog->code + chain);
+    patch(chain, dst);
+    chain = next;
+  }
 }
 
+
 // ---------- UTIL ----------
 static void syntax(const char *msg){
-  printf("[syntax] %s @ %d\n", msg, lx.pos);
-  exit(1);
+  printf("[syntax] %s @ %lu (line %d)\n", msg, (unsigned long)(lx.base + lx.pos), lx.line);
+  longjmp(compile_fail, 1);
 }
 
-static int sym_lookup(const char *name){
-  for(int i=vm.sym.count-1;i>=0;i--)
-    if(!strcmp(vm.sym.table[i].name,name) &&
-       vm.sym.table[i].scope_level<=vm.sym.scope_level)
+// FNV-1a de 32 bits (símbolos y cache de bytecode). El lexer lo calcula
+// sobre la marcha en lx.id_hash mientras lee cada identificador.
+#define FNV_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+static constexpr uint32_t minic_hash(const char *data, size_t len, uint32_t h = FNV_BASIS){
+  for(size_t i = 0; i < len; i++)
+    h = (h ^ (uint8_t)data[i]) * FNV_PRIME;
+  return h;
+}
+
+// Tabla de símbolos: cada cubeta es una lista (vía Symbol.next) del más
+// reciente al más antiguo, así que el primero que coincide es el del scope
+// más interno. leave_scope() desapila los símbolos y restaura las cabezas.
+static int sym_lookup_h(const char *name, uint32_t h){
+  for(int i = cc->sym.bucket[h % SYM_BUCKETS] - 1; i >= 0; i = cc->sym.table[i].next)
+    if(cc->sym.table[i].hash == h && !strcmp(cc->sym.table[i].name, name) &&
+       (i < cc->sym.hide_from || i >= cc->sym.hide_to))
       return i;
   return -1;
 }
+static int sym_lookup(const char *name){
+  return sym_lookup_h(name, minic_hash(name, strlen(name)));
+}
 
 static int sym_add(const char *name, ValueType t, SymKind k){
-  if(vm.sym.count >= MAX_SYM) syntax("symbol overflow");
-  Symbol *s = &vm.sym.table[vm.sym.count++];
+  if(cc->sym.count >= MAX_SYM) syntax("symbol overflow");
+  int si = cc->sym.count++;
+  Symbol *s = &cc->sym.table[si];
   strncpy(s->name,name,sizeof(s->name)-1);
+  s->name[sizeof(s->name)-1] = '\0';
+  s->hash = minic_hash(s->name, strlen(s->name));
+  int16_t *head = &cc->sym.bucket[s->hash % SYM_BUCKETS];
+  s->next = *head - 1;
+  *head = si + 1;
   s->type = t;
   s->kind = k;
-  s->scope_level = vm.sym.scope_level;
+  s->scope_level = cc->sym.scope_level;
   if (k == SYM_VAR_GLOBAL) {
-	  s->index = vm.sym.global_count++;
-  } else if (k == SYM_VAR_LOCAL) {
-	  s->index = vm.frames[vm.fp].local_count++;
-  } else if (k == SYM_PARAM) {
-	  s->index = vm.frames[vm.fp].param_count++;
+	  if (prog->global_count >= MAX_VARS) syntax("too many globals");
+	  s->index = prog->global_count++;
+	  // 0 del tipo declarado; strings y arrays empiezan sin valor
+	  if (t != T_STRING && t != T_ARRAY) prog->global_types[s->index] = t;
+	  size_t n = strlen(s->name) + 1;
+	  prog->global_names[s->index] = (const char *)memcpy(arena_alloc(n), s->name, n);
+  } else if (k == SYM_VAR_LOCAL || k == SYM_PARAM) {
+	  // los parámetros son los primeros locals del frame
+	  if (cc->frames[cc->fp].local_count >= MAX_VARS) syntax("too many locals");
+	  s->index = cc->frames[cc->fp].local_count++;
+	  if (k == SYM_PARAM) cc->frames[cc->fp].param_count++;
   } else if (k == SYM_FUNC ) {
-	  s->index = vm.func_count++;  // or native index — adjust as needed
-  } else if(k == SYM_NATIVE){
-	/* el índice ya viene asignado externamente */  
+	  prog->funcs = (Function *)segment_reserve(prog->funcs, &prog->func_cap, prog->func_count + 1,
+	                                           sizeof(Function), 8, MAX_FUNCS, "too many funcs");
+	  s->index = prog->func_count++;
+	  memset(&prog->funcs[s->index], 0, sizeof(Function));
   } else {
 	  s->index = 0;
   }
-  return vm.sym.count-1;
+  return si;
+}
+
+// Nativas: native_table (sys.h) es estática y nunca se copia a la tabla de
+// símbolos. Su índice es un hash perfecto generado en compilación: se
+// busca una semilla con la que cada nombre cae en un slot distinto, así
+// que reconocer una nativa es una sola comparación.
+#define NATIVE_COUNT ((int)(sizeof(native_table) / sizeof(native_table[0])))
+#define NATIVE_SLOTS 64   // potencia de 2; native_slot() toma los 6 bits altos
+
+static constexpr int native_slot(uint32_t h, uint32_t seed){
+  return (int)(((h ^ seed) * 2654435761u) >> 26);
+}
+
+typedef struct {
+  uint32_t seed;
+  int8_t slot[NATIVE_SLOTS];   // índice en native_table, -1 = libre
+  bool ok;
+} NativeIndex;
+
+static constexpr NativeIndex native_build(void){
+  NativeIndex t{};
+  for(uint32_t seed = 0; seed < 4096 && !t.ok; seed++){
+    for(int i = 0; i < NATIVE_SLOTS; i++) t.slot[i] = -1;
+    t.seed = seed;
+    t.ok = true;
+    for(int i = 0; i < NATIVE_COUNT && t.ok; i++){
+      const char *n = native_table[i].name;
+      size_t len = 0;
+      while(n[len]) len++;
+      int k = native_slot(minic_hash(n, len), seed);
+      if(t.slot[k] >= 0) t.ok = false;
+      else t.slot[k] = i;
+    }
+  }
+  return t;
+}
+static constexpr NativeIndex native_index = native_build();
+static_assert(NATIVE_COUNT <= NATIVE_SLOTS && native_index.ok,
+              "native_table sin hash perfecto: subir NATIVE_SLOTS");
+
+static int native_lookup(const char *name, uint32_t h){
+  int i = native_index.slot[native_slot(h, native_index.seed)];
+  return i >= 0 && !strcmp(native_table[i].name, name) ? i : -1;
+}
+
+// Slot de 1 byte de las superinstrucciones: bit 7 = local del frame actual.
+// PUSH/STORE llevan la distinción en el propio opcode (_LOCAL/_GLOBAL).
+#if MAX_VARS > 128
+#error "MAX_VARS no cabe en un slot de 7 bits"
+#endif
+#define SLOT_LOCAL 0x80
+
+static uint8_t var_slot(const Symbol *s){
+  return s->index | (s->kind == SYM_VAR_GLOBAL ? 0 : SLOT_LOCAL);
+}
+static void emit_load(const Symbol *s){
+  emit(s->kind == SYM_VAR_GLOBAL ? OP_PUSH_GLOBAL : OP_PUSH_LOCAL);
+  emit(s->index);
+}
+static void emit_store(const Symbol *s){
+  emit(s->kind == SYM_VAR_GLOBAL ? OP_STORE_GLOBAL : OP_STORE_LOCAL);
+  emit(s->index);
+}
+
+static Symbol *var_lookup(const char *name, uint32_t h){
+  int si = sym_lookup_h(name, h);
+  if(si < 0) syntax("unknown id");
+  Symbol *s = &cc->sym.table[si];
+  if(s->kind == SYM_FUNC) syntax("not a variable");
+  return s;
+}
+
+// ---------- PATRONES DE BYTECODE ----------
+// Para reconocer secuencias ya emitidas (peephole(), for_stmt())
+#define MINIC_OP_LEN(op, len) len,
+static const uint8_t op_len[OP_COUNT] = { MINIC_OPCODES(MINIC_OP_LEN) };
+#undef MINIC_OP_LEN
+
+// saltos: el destino es siempre su primer operando
+static int op_is_jump(uint8_t op){
+  return op == OP_JMP || op == OP_JMP_FALSE || op == OP_JMP_TRUE ||
+         (op >= OP_EQ_JMP_FALSE && op <= OP_GE_JMP_FALSE) ||
+         op == OP_FOR_LT_CONST || op == OP_FOR_LT_VAR;
+}
+
+// +1 / -1 si op es una suma / resta (genérica o tipada), 0 si no
+static int add_sign(uint8_t op){
+  switch(op){
+    case OP_ADD: case OP_ADD_I32: case OP_ADD_I8: case OP_ADD_I16: return 1;
+    case OP_SUB: case OP_SUB_I32: case OP_SUB_I8: case OP_SUB_I16: return -1;
+    default: return 0;
+  }
+}
+
+static int is_i32_add(uint8_t op){ return op == OP_ADD_I32 || op == OP_SUB_I32; }
+
+static int is_push_var(uint8_t op){ return op == OP_PUSH_GLOBAL || op == OP_PUSH_LOCAL; }
+
+// slot de superinstrucción de un PUSH_/STORE_ GLOBAL|LOCAL en `p`
+static uint8_t slot_at(const uint8_t *p){
+  return p[1] | (p[0] == OP_PUSH_LOCAL || p[0] == OP_STORE_LOCAL ? SLOT_LOCAL : 0);
+}
+
+// ¿`st` es el STORE que corresponde al PUSH `ld` (misma variable)?
+static int same_var(const uint8_t *ld, const uint8_t *st){
+  return st[0] == (ld[0] == OP_PUSH_LOCAL ? OP_STORE_LOCAL : OP_STORE_GLOBAL) && st[1] == ld[1];
 }
 
 // ---------- LEXER ----------
+// Palabras clave: hash perfecto sobre (longitud, primer y último carácter)
+// generado en compilación; static_assert avisa si una nueva colisiona.
+typedef struct {
+  const char *name;
+  Token tok;
+} Keyword;
+
+static constexpr Keyword keywords[] = {
+  { "if",       KW_IF },
+  { "else",     KW_ELSE },
+  { "while",    KW_WHILE },
+  { "for",      KW_FOR },
+  { "return",   KW_RETURN },
+  { "break",    KW_BREAK },
+  { "continue", KW_CONTINUE },
+  { "switch",   KW_SWITCH },
+  { "case",     KW_CASE },
+  { "default",  KW_DEFAULT },
+  { "func",     KW_FUNC },
+  { "var",      KW_VAR },
+  { "call",     KW_CALL },
+  { "int8",     KW_INT8 },
+  { "int16",    KW_INT16 },
+  { "int32",    KW_INT32 },
+  { "bool",     KW_BOOL },
+  { "string",   KW_STRING },
+};
+#define KW_COUNT ((int)(sizeof(keywords) / sizeof(keywords[0])))
+#define KW_SLOTS 32
+
+static constexpr int kw_slot(const char *s, int len){
+  return (9 * (uint8_t)s[0] + 27 * (uint8_t)s[len - 1] + len) & (KW_SLOTS - 1);
+}
+
+typedef struct {
+  int8_t slot[KW_SLOTS];   // índice en keywords, -1 = libre
+  bool ok;
+} KwIndex;
+
+static constexpr KwIndex kw_build(void){
+  KwIndex t{};
+  for(int i = 0; i < KW_SLOTS; i++) t.slot[i] = -1;
+  t.ok = true;
+  for(int i = 0; i < KW_COUNT; i++){
+    int len = 0;
+    while(keywords[i].name[len]) len++;
+    int k = kw_slot(keywords[i].name, len);
+    if(t.slot[k] >= 0) t.ok = false;
+    t.slot[k] = i;
+  }
+  return t;
+}
+static constexpr KwIndex kw_index = kw_build();
+static_assert(kw_index.ok, "colisión en kw_slot(): ajustar sus coeficientes");
+
+// ---------- FUENTE ----------
+static void lx_open(const char *src){
+  memset(&lx, 0, sizeof(lx));
+  lx.src = src;
+  lx.line = 1;
+}
+
+static void lx_open_reader(MinicReader read, void *ctx, MinicSeek seek){
+  memset(&lx, 0, sizeof(lx));
+  lx.line = 1;
+  lx.read = read;
+  lx.seek = seek;
+  lx.ctx = ctx;
+  lx.src = lx.window;   // vacía: el primer next_tok() la rellena
+}
+
+// Desliza lo que queda sin leer al principio de la ventana y la completa
+// desde el lector
+static void lx_refill(void){
+  int rest = lx.end - lx.pos;
+  memmove(lx.window, lx.window + lx.pos, rest);
+  lx.base += lx.pos;
+  lx.pos = 0;
+  lx.end = rest;
+  int n = lx.read(lx.ctx, lx.window + rest, LX_WINDOW - rest);
+  if (n > 0) lx.end += n;
+  else lx.eof = 1;
+  lx.window[lx.end] = '\0';
+}
+
+// Posición en el fuente del token actual de un carácter (p.ej. '(')
+static uint32_t lx_tok_pos(void){ return lx.base + lx.pos - 1; }
+
+static int lx_can_seek(void){ return !lx.read || lx.seek; }
+
+// Sigue leyendo el fuente desde `pos`, que está en la línea `line`
+static void lx_seek(uint32_t pos, int line){
+  if(!lx.read){
+    lx.pos = pos;
+  } else if(pos >= lx.base && pos <= lx.base + lx.end){
+    lx.pos = pos - lx.base;   // aún en la ventana
+  } else {
+    if(!lx.seek(lx.ctx, pos)) syntax("source seek failed");
+    lx.base = pos;
+    lx.pos = lx.end = lx.eof = 0;
+    lx.window[0] = '\0';     // el próximo next_tok() la rellena
+  }
+  lx.line = line;
+}
+
+static int file_reader(void *ctx, char *dst, int n){
+  return ((File *)ctx)->read((uint8_t *)dst, n);
+}
+static int file_seek(void *ctx, uint32_t pos){
+  return ((File *)ctx)->seek(pos);
+}
+
 // operadores compuestos (two-character tokens)
-static inline void try_match2(char c, char next_expected, Token token_if_match)
+static inline int try_match2(char c, char next_expected, Token token_if_match)
 {
     if (c == lx.src[lx.pos] && lx.src[lx.pos + 1] == next_expected)
     {
         lx.pos += 2;
         lx.tok = token_if_match;
-        return;   // ¡importante! salimos si coincidió
+        return 1;   // ¡importante! el llamador debe salir si coincidió
     }
-    // si no coincide, simplemente seguimos (no hacemos nada)
+    return 0;
 }
 
 static void next_tok(void)
 {
-    // Skip whitespace
-    while (isspace((unsigned char)lx.src[lx.pos]))
-        lx.pos++;
+    // Skip whitespace; con lector, la ventana se rellena antes de un token
+    // que podría cruzar su final
+    for (;;) {
+        while (isspace((unsigned char)lx.src[lx.pos]))
+            if (lx.src[lx.pos++] == '\n') lx.line++;
+        if (!lx.read || lx.eof || lx.end - lx.pos >= LX_LOOKAHEAD) break;
+        lx_refill();
+    }
 
     char c = lx.src[lx.pos];
     if (!c) {
@@ -95,31 +531,25 @@ static void next_tok(void)
         return;
     }
 
-    // Identifiers & Keywords
+    // Identifiers & Keywords: el hash FNV del nombre (para la tabla de
+    // símbolos) se calcula en la misma pasada y la palabra clave se
+    // reconoce con una sola sonda en kw_index
     if (isalpha((unsigned char)c) || c == '_') {
         int i = 0;
-        while ((isalnum((unsigned char)lx.src[lx.pos]) || lx.src[lx.pos] == '_') && i < 31)
-            lx.id[i++] = lx.src[lx.pos++];
+        uint32_t h = FNV_BASIS;
+        while ((isalnum((unsigned char)lx.src[lx.pos]) || lx.src[lx.pos] == '_') && i < 31) {
+            char ch = lx.src[lx.pos++];
+            lx.id[i++] = ch;
+            h = (h ^ (uint8_t)ch) * FNV_PRIME;
+        }
         lx.id[i] = '\0';
+        lx.id_hash = h;
 
-        #define KW(x, t) if (!strcmp(lx.id, x)) { lx.tok = t; return; }
-        KW("if",       KW_IF)
-        KW("else",     KW_ELSE)
-        KW("while",    KW_WHILE)
-        KW("for",      KW_FOR)
-        KW("return",   KW_RETURN)
-        KW("break",    KW_BREAK)
-        KW("continue", KW_CONTINUE)
-        KW("func",     KW_FUNC)
-        KW("var",      KW_VAR)
-        KW("call",     KW_CALL)
-        KW("int8",     KW_INT8)
-        KW("int16",    KW_INT16)
-        KW("int32",    KW_INT32)
-        KW("bool",     KW_BOOL)
-        KW("string",   KW_STRING)
-        #undef KW
-
+        int k = kw_index.slot[kw_slot(lx.id, i)];
+        if (k >= 0 && !strcmp(keywords[k].name, lx.id)) {
+            lx.tok = keywords[k].tok;
+            return;
+        }
         lx.tok = TK_ID;
         return;
     }
@@ -128,8 +558,10 @@ static void next_tok(void)
     if (c == '"') {
         lx.pos++;  // skip opening "
         int i = 0;
-        while (lx.src[lx.pos] && lx.src[lx.pos] != '"' && i < MAX_STRING - 1)
+        while (lx.src[lx.pos] && lx.src[lx.pos] != '"' && i < MAX_STRING - 1) {
+            if (lx.src[lx.pos] == '\n') lx.line++;
             lx.str[i++] = lx.src[lx.pos++];
+        }
         lx.str[i] = '\0';
 
         if (lx.src[lx.pos] == '"')
@@ -141,24 +573,25 @@ static void next_tok(void)
     }
 
     // Compound operators (longest match first)
-    try_match2('+', '+', TK_INC);
-    try_match2('-', '-', TK_DEC);
-    try_match2('*', '=', TK_MUL_ASSIGN);
-    try_match2('/', '=', TK_DIV_ASSIGN);
-    try_match2('%', '=', TK_MOD_ASSIGN);
-    try_match2('=', '=', TK_EQ);
-    try_match2('!', '=', TK_NE);
-    try_match2('<', '=', TK_LE);
-    try_match2('>', '=', TK_GE);
-    try_match2('&', '&', TK_AND);
-    try_match2('|', '|', TK_OR);
-	try_match2('+', '=', TK_ADD_ASSIGN);      // +=
-	try_match2('-', '=', TK_SUB_ASSIGN);      // -=
-	try_match2('<', '<', TK_SHL);             // <<
-	try_match2('>', '>', TK_SHR);             // >>
-	try_match2('&', '=', TK_AND_ASSIGN);      // &=
-	try_match2('|', '=', TK_OR_ASSIGN);       // |=
-	try_match2('^', '=', TK_XOR_ASSIGN);      // ^=
+    if (try_match2('+', '+', TK_INC)) return;
+    if (try_match2('-', '-', TK_DEC)) return;
+    if (try_match2('*', '=', TK_MUL_ASSIGN)) return;
+    if (try_match2('/', '=', TK_DIV_ASSIGN)) return;
+    if (try_match2('%', '=', TK_MOD_ASSIGN)) return;
+    if (try_match2('=', '=', TK_EQ)) return;
+    if (try_match2('!', '=', TK_NE)) return;
+    if (try_match2('<', '=', TK_LE)) return;
+    if (try_match2('>', '=', TK_GE)) return;
+    if (try_match2('&', '&', TK_AND)) return;
+    if (try_match2('|', '|', TK_OR)) return;
+	if (try_match2('+', '=', TK_ADD_ASSIGN)) return;      // +=
+	if (try_match2('-', '=', TK_SUB_ASSIGN)) return;      // -=
+	if (try_match2('<', '<', TK_SHL)) return;             // <<
+	if (try_match2('>', '>', TK_SHR)) return;             // >>
+	if (try_match2('&', '=', TK_AND_ASSIGN)) return;      // &=
+	if (try_match2('|', '=', TK_OR_ASSIGN)) return;       // |=
+	if (try_match2('^', '=', TK_XOR_ASSIGN)) return;      // ^=
+
 
     // Single character tokens
     lx.pos++;
@@ -168,6 +601,9 @@ static void next_tok(void)
         case '*': lx.tok = TK_MUL;       break;
         case '/': lx.tok = TK_DIV;       break;
         case '%': lx.tok = TK_MOD;       break;
+        case '&': lx.tok = TK_BAND;      break;
+        case '|': lx.tok = TK_BOR;       break;
+        case '^': lx.tok = TK_XOR;       break;
         case '<': lx.tok = TK_LT;        break;
         case '>': lx.tok = TK_GT;        break;
         case '!': lx.tok = TK_NOT;       break;
@@ -180,6 +616,7 @@ static void next_tok(void)
         case ']': lx.tok = TK_RB;        break;
         case ',': lx.tok = TK_COMMA;     break;
         case ';': lx.tok = TK_SEMI;      break;
+        case ':': lx.tok = TK_COLON;     break;
         default:
             // Unknown character → you should report error
             // For now we just set TK_END (maybe add syntax error later)
@@ -189,155 +626,499 @@ static void next_tok(void)
 }
 
 // ---------- EXPRESIONES ----------
-static void expr();
-static void unary() {
+static ValueType expr();
+
+// ¿El código en [start, end) es exactamente un PUSH_I8/I16/CONST? Es la
+// forma en que el parser sabe que una subexpresión es constante.
+static int const_at(int start, int end, int32_t *v){
+  const uint8_t *c = prog->code + start;
+  if(end == start + 2 && c[0] == OP_PUSH_I8) *v = (int8_t)c[1];
+  else if(end == start + 3 && c[0] == OP_PUSH_I16) *v = (int16_t)RD16(c + 1);
+  else if(end == start + 5 && c[0] == OP_PUSH_CONST) *v = (int32_t)RD32(c + 1);
+  else return 0;
+  return 1;
+}
+
+// Evalúa a op b en compilación; 0 si no se puede (÷0, desplazamiento
+// fuera de rango...) y se deja para el runtime.
+static int fold_binop(OpCode op, int32_t a, int32_t b, int32_t *r){
+  switch(op){
+    case OP_ADD: *r = (int32_t)((uint32_t)a + (uint32_t)b); return 1;
+    case OP_SUB: *r = (int32_t)((uint32_t)a - (uint32_t)b); return 1;
+    case OP_MUL: *r = (int32_t)((uint32_t)a * (uint32_t)b); return 1;
+    case OP_DIV:
+    case OP_MOD:
+      if(b == 0) return 0;   // el fallo es del runtime
+      if(b == -1) a = (int32_t)(0u - (uint32_t)a), b = 1;   // como VM_DIV
+      *r = op == OP_DIV ? a / b : a % b;
+      return 1;
+    case OP_SHL: if(b < 0 || b > 31) return 0; *r = (int32_t)((uint32_t)a << b); return 1;
+    case OP_SHR: if(b < 0 || b > 31) return 0; *r = a >> b; return 1;
+    case OP_BAND: *r = a & b; return 1;
+    case OP_BOR:  *r = a | b; return 1;
+    case OP_XOR:  *r = a ^ b; return 1;
+    case OP_EQ: *r = a == b; return 1;
+    case OP_NE: *r = a != b; return 1;
+    case OP_LT: *r = a <  b; return 1;
+    case OP_GT: *r = a >  b; return 1;
+    case OP_LE: *r = a <= b; return 1;
+    case OP_GE: *r = a >= b; return 1;
+    default: return 0;
+  }
+}
+
+// ---------- TIPOS ESTÁTICOS ----------
+// Cada nivel del parser devuelve el tipo de la expresión que compiló
+// (T_ANY si no se conoce). Las variables guardan siempre su tipo declarado
+// (coerce() en cada store/argumento/return), así que con ambos operandos
+// enteros conocidos se emiten opcodes tipados que operan sobre el entero
+// crudo sin pasar por i32_to_value().
+static int is_int_type(ValueType t){
+  return t == T_I8 || t == T_I16 || t == T_I32 || t == T_BOOL;
+}
+
+// Convierte el valor en la cima (de tipo estático `from`) al tipo `to`.
+// Un array solo va a donde se espera un array.
+static void coerce(ValueType from, ValueType to){
+  if(from == to) return;
+  if(to == T_ARRAY ? from != T_ANY : from == T_ARRAY && to != T_ANY && to != T_VOID)
+    syntax("array type mismatch");
+  if(!is_int_type(to)) return;
+  switch(to){
+    case T_I8:  emit(OP_CAST_I8);  break;
+    case T_I16: emit(OP_CAST_I16); break;
+    case T_I32: emit(OP_CAST_I32); break;
+    default:    emit(OP_CAST_BOOL); break;
+  }
+}
+
+static int is_cmp_op(OpCode op){
+  return op == OP_EQ || op == OP_NE || op == OP_LT || op == OP_GT || op == OP_LE || op == OP_GE;
+}
+
+// versión int32 sin despacho de tipo; OP_NOP si no la hay
+static OpCode typed_i32_op(OpCode op){
+  switch(op){
+    case OP_ADD:  return OP_ADD_I32;
+    case OP_SUB:  return OP_SUB_I32;
+    case OP_MUL:  return OP_MUL_I32;
+    case OP_DIV:  return OP_DIV_I32;
+    case OP_MOD:  return OP_MOD_I32;
+    case OP_BAND: return OP_BAND_I32;
+    case OP_BOR:  return OP_BOR_I32;
+    case OP_XOR:  return OP_XOR_I32;
+    case OP_SHL:  return OP_SHL_I32;
+    case OP_SHR:  return OP_SHR_I32;
+    default:      return OP_NOP;
+  }
+}
+
+// Emite el operador binario cuyo operando izquierdo (tipo lt) empieza en
+// `lstart` y el derecho (tipo rt) en `rstart`: pliega constantes,
+// simplifica x*1, x+0, x*2^k... y elige la variante tipada si puede.
+// Devuelve el tipo estático del resultado.
+static ValueType emit_binop(OpCode op, int lstart, int rstart, ValueType lt, ValueType rt){
+  // un array no es un número: sumarle algo daría otro handle
+  if(lt == T_ARRAY || rt == T_ARRAY) syntax("array type mismatch");
+  int32_t a, b, r;
+  int rc = const_at(rstart, prog->code_size, &b);
+  if(rc && const_at(lstart, rstart, &a) && fold_binop(op, a, b, &r)){
+    prog->code_size = lstart;
+    emit_const(r);
+    return T_I32;
+  }
+  // solo con el izquierdo entero: con uno de tipo desconocido el opcode
+  // genérico puede no ser la identidad
+  if(rc && is_int_type(lt)){
+    // elemento neutro a la derecha: el operando izquierdo queda tal cual,
+    // salvo que un bool promociona a int32 como lo haría el opcode
+    if((b == 0 && (op == OP_ADD || op == OP_SUB || op == OP_SHL || op == OP_SHR ||
+                   op == OP_BOR || op == OP_XOR)) ||
+       (b == 1 && (op == OP_MUL || op == OP_DIV))){
+      prog->code_size = rstart;
+      if(lt != T_BOOL) return lt;
+      emit(OP_CAST_I32);
+      return T_I32;
+    }
+    // x * 2^k  ->  x << k
+    if(op == OP_MUL && b > 1 && (b & (b - 1)) == 0){
+      int k = 0;
+      while((1 << k) != b) k++;
+      prog->code_size = rstart;
+      emit_const(k);
+      op = OP_SHL;
+    }
+  }
+  // las comparaciones ya comparan el entero crudo y producen bool
+  if(is_cmp_op(op)){
+    emit(op);
+    return T_BOOL;
+  }
+  if(!is_int_type(lt) || !is_int_type(rt)){
+    emit(op);   // tipos desconocidos: opcode genérico
+    return T_ANY;
+  }
+  ValueType res = lt == T_BOOL ? T_I32 : lt;   // bool promociona a int32
+  if(res == T_I32)
+    emit(typed_i32_op(op));
+  else if(op == OP_ADD)
+    emit(res == T_I8 ? OP_ADD_I8 : OP_ADD_I16);
+  else if(op == OP_SUB)
+    emit(res == T_I8 ? OP_SUB_I8 : OP_SUB_I16);
+  else
+    emit(op);   // resto de int8/int16: el genérico ya envuelve por a.type
+  return res;
+}
+
+// ---------- EXPANSIÓN EN LÍNEA ----------
+// Una función hoja (sin llamadas a otras de MiniC), sin más locals que
+// sus parámetros y de cuerpo corto se copia en cada llamada en vez de
+// llamarla: los argumentos pasan a locals ocultos del llamador y cada
+// RET salta al final de la copia.
+
+// Bytes del cuerpo de fi (recién compilada) que se copian al expandirla,
+// terminando en su último RET; 0 si no es expandible
+static int inline_size(int fi){
+  const Function *f = &prog->funcs[fi];
+  const uint8_t *c = prog->code + f->code_start;
+  int len = prog->code_size - f->code_start;   // hasta el return implícito
+  if(len > INLINE_MAX + 3 || f->local_count != f->param_count) return 0;
+  int tail = len - 3, last = -1, jumps_to_tail = 0;
+  for(int pc = 0; pc < len; pc += 1 + op_len[c[pc]]){
+    if(c[pc] == OP_CALL || c[pc] == OP_TAIL_CALL) return 0;
+    if(op_is_jump(c[pc]) && RD16(c + pc + 1) - f->code_start >= tail) jumps_to_tail = 1;
+    if(pc < tail) last = pc;
+  }
+  // termina en `return e;`: el `return 0` implícito no se alcanza
+  if(last >= 0 && c[last] == OP_RET && !jumps_to_tail) len = tail;
+  return len <= INLINE_MAX ? len : 0;
+}
+
+// slot de superinstrucción de la copia: los locals pasan a los ocultos
+static void inline_remap(const Frame *fr, uint8_t *slot){
+  if(*slot & SLOT_LOCAL) *slot = SLOT_LOCAL | fr->inline_slot[*slot & ~SLOT_LOCAL];
+}
+
+// Expande la llamada a fi con los argumentos ya apilados; 0 si no procede.
+// Los operandos de la copia cuentan en el max_depth del llamador porque
+// stack_depths() recorre el código ya expandido.
+static int inline_call(int fi){
+  const Function *f = &prog->funcs[fi];
+  Frame *fr = &cc->frames[cc->fp];
+  int len = cc->fn[fi].inline_len, from = f->code_start;
+  if(!minic_opt || !len || cc->fp <= 0) return 0;
+  while(fr->inline_slots < f->param_count){
+    if(fr->local_count >= MAX_VARS) return 0;
+    fr->inline_slot[fr->inline_slots++] = fr->local_count++;
+  }
+  for(int i = f->param_count; i-- > 0; ){
+    emit(OP_STORE_LOCAL);
+    emit(fr->inline_slot[i]);
+  }
+  // posición de cada instrucción en la copia: los RET interiores pasan a
+  // ser JMP (3 bytes) y el último desaparece
+  uint8_t map[INLINE_MAX + 1];
+  int n = 0;
+  for(int pc = 0; pc < len; pc += 1 + op_len[prog->code[from + pc]]){
+    uint8_t op = prog->code[from + pc];
+    map[pc] = n;
+    n += op != OP_RET ? 1 + op_len[op] : pc < len - 1 ? 3 : 0;
+  }
+  map[len] = n;
+  int at = prog->code_size;
+  for(int pc = 0; pc < len; pc += 1 + op_len[prog->code[from + pc]]){
+    uint8_t op = prog->code[from + pc];
+    if(op == OP_RET){
+      if(pc < len - 1){ emit(OP_JMP); emit_u16(at + n); }
+      continue;
+    }
+    emit(op);
+    for(int i = 1; i <= op_len[op]; i++) emit(prog->code[from + pc + i]);
+    uint8_t *d = prog->code + prog->code_size - op_len[op];   // operandos copiados
+    if(op_is_jump(op)) patch((int)(d - prog->code), at + map[RD16(d) - from]);
+    if(op == OP_PUSH_LOCAL || op == OP_STORE_LOCAL) d[0] = fr->inline_slot[d[0]];
+    if(op == OP_FOR_LT_CONST || op == OP_FOR_LT_VAR) inline_remap(fr, d + 2);
+    if(op == OP_FOR_LT_VAR) inline_remap(fr, d + 4);
+  }
+  if(minic_inline_report) printf("[inline] %s (line %d)\n", f->name, cc->line);
+  return 1;
+}
+
+// Identificador ya consumido (h = su hash): llamada a función/nativa o
+// lectura de variable
+static ValueType ident(const char *name, uint32_t h) {
+  int si = sym_lookup_h(name, h);
+  int ni = si < 0 ? native_lookup(name, h) : -1;
+  if (si < 0 && ni < 0) syntax("unknown id");
+  Symbol *s = si >= 0 ? &cc->sym.table[si] : NULL;
+  if (lx.tok == TK_LP) {  // Function or native call
+    next_tok();
+    Function *f = s && s->kind == SYM_FUNC ? &prog->funcs[s->index] : NULL;
+    int argc = 0;
+    while (lx.tok != TK_RP) {
+      ValueType t = expr();
+      if (f && argc < f->param_count) coerce(t, (ValueType)f->param_types[argc]);
+      else if (ni >= 0 && argc < MAX_PARAM && native_table[ni].arr_args >> argc & 1) coerce(t, T_ARRAY);
+      else if (ni >= 0 && t == T_ARRAY) syntax("array type mismatch");
+      argc++;
+      if (lx.tok == TK_COMMA) next_tok();
+    }
+    next_tok();
+    if (f) {
+      if (argc != f->param_count) syntax("arg mismatch");
+      if (inline_call(s->index)) return is_int_type(f->ret_type) ? f->ret_type : T_ANY;
+      if (cc->fn[s->index].state == FN_LAZY) cc->fn[s->index].state = FN_CALLED;
+      cc->last_call = prog->code_size;
+      emit(OP_CALL);
+      emit(s->index);
+      return is_int_type(f->ret_type) ? f->ret_type : T_ANY;
+    } else if (ni >= 0) {
+      if (argc != native_table[ni].argc) syntax("arg mismatch");
+      emit(OP_NATIVE_CALL);
+      emit(ni);
+      emit(argc);
+      return native_table[ni].str_ret ? T_STRING : T_I32;
+    }
+    syntax("not callable");
+  }
+  if (!s || s->kind == SYM_FUNC) syntax("not a variable");
+  emit_load(s);
+  if (lx.tok == TK_LB) {   // a[i]: el elemento sale como int32
+    if (s->type != T_ARRAY) syntax("not an array");
+    next_tok();
+    expr();
+    if (lx.tok != TK_RB) syntax("expected ]");
+    next_tok();
+    emit(OP_ARR_LOAD);
+    return T_I32;
+  }
+  if (lx.tok == TK_INC || lx.tok == TK_DEC) {   // x++ como valor: deja el anterior
+    Token op = lx.tok;
+    next_tok();
+    int lstart = prog->code_size;
+    emit(OP_DUP);
+    int rstart = prog->code_size;
+    emit_const(1);
+    coerce(emit_binop(op == TK_INC ? OP_ADD : OP_SUB, lstart, rstart, s->type, T_I32), s->type);
+    emit_store(s);
+  }
+  return s->type;
+}
+
+static ValueType unary() {
+  if (pend_id[0]) {
+    char name[32];
+    strcpy(name, pend_id);
+    pend_id[0] = '\0';
+    return ident(name, pend_hash);
+  }
   if (lx.tok == TK_MINUS || lx.tok == TK_NOT) {
     Token op = lx.tok;
     next_tok();
-    unary();
+    int start = prog->code_size;
+    int32_t v;
+    ValueType t = unary();
+    if (t == T_ARRAY) syntax("array type mismatch");
+    if (const_at(start, prog->code_size, &v)) {  // -k, !k: se pliega en el sitio
+      prog->code_size = start;
+      emit_const(op == TK_MINUS ? (int32_t)(0u - (uint32_t)v) : !v);
+      return T_I32;
+    }
     emit(op == TK_MINUS ? OP_NEG : OP_NOT);
-    return;
+    return t == T_BOOL ? T_I32 : is_int_type(t) ? t : T_ANY;
   }
   if (lx.tok == TK_INC || lx.tok == TK_DEC) {
     Token op = lx.tok;
     next_tok();
     if (lx.tok != TK_ID) syntax("id expected after inc/dec");
-    int si = sym_lookup(lx.id);
-    if (si < 0) syntax("unknown id");
-    emit(OP_PUSH_VAR);
-    emit_i(vm.sym.table[si].index);
-    emit(OP_PUSH_CONST);
-    emit_i(1);
-    emit(op == TK_INC ? OP_ADD : OP_SUB);
-    emit(OP_STORE_VAR);
-    emit_i(vm.sym.table[si].index);
+    Symbol *s = var_lookup(lx.id, lx.id_hash);
+    int lstart = prog->code_size;
+    emit_load(s);
+    int rstart = prog->code_size;
+    emit_const(1);
+    ValueType t = emit_binop(op == TK_INC ? OP_ADD : OP_SUB, lstart, rstart, s->type, T_I32);
+    coerce(t, s->type);
+    emit(OP_DUP);   // ++x es una expresión: deja el nuevo valor
+    emit_store(s);
     next_tok();
-    return;
+    return s->type;
   }
   // Factor with function call support
   if (lx.tok == TK_ID) {
     char name[32];
     strncpy(name, lx.id, 31);
+    name[31] = '\0';
+    uint32_t h = lx.id_hash;
     next_tok();
-    int si = sym_lookup(name);
-    if (si < 0) syntax("unknown id");
-    Symbol *s = &vm.sym.table[si];
-    if (lx.tok == TK_LP) {  // Function or native call
-      next_tok();
-      int argc = 0;
-      while (lx.tok != TK_RP) {
-        expr();
-        argc++;
-        if (lx.tok == TK_COMMA) next_tok();
-      }
-      next_tok();
-      if (s->kind == SYM_FUNC) {
-        if (argc != vm.funcs[s->index].param_count) syntax("arg mismatch");
-        emit(OP_CALL);
-        emit_i(s->index);
-      } else if (s->kind == SYM_NATIVE) {
-        emit(OP_NATIVE_CALL);
-        emit_i(s->index);
-        emit_i(argc);
-      } else {
-        syntax("not callable");
-      }
-      return;
-    } else {  // Variable
-      emit(OP_PUSH_VAR);
-      emit_i(s->index | (s->kind == SYM_VAR_LOCAL ? 0x80000000 : 0));
-      return;
-    }
+    return ident(name, h);
   }
   if (lx.tok == TK_NUM) {
-    emit(OP_PUSH_CONST);
-    emit_i(lx.val);
+    emit_const(lx.val);
     next_tok();
-    return;
+    return T_I32;
   }
   if (lx.tok == TK_STRING) {
-    int sid = vm.string_count++;
-    if (vm.string_count >= MAX_STR_POOL) syntax("string pool overflow");
-    vm.string_pool[sid] = strdup(lx.str);
-    emit(OP_PUSH_CONST);
-    emit_i(sid | (1 << 30));  // Tag as string
+    emit(OP_PUSH_STR);
+    emit(intern(lx.str));
     next_tok();
-    return;
+    return T_STRING;
   }
   if (lx.tok == TK_LP) {
     next_tok();
-    expr();
+    ValueType t = expr();
     if (lx.tok != TK_RP) syntax("expected )");
     next_tok();
-    return;
+    return t;
   }
   syntax("bad factor");
+  return T_ANY;
 }
 
-static void term(){
-  unary();
+static ValueType term(){
+  int lstart = prog->code_size;
+  ValueType lt = unary();
   while(lx.tok==TK_MUL||lx.tok==TK_DIV||lx.tok==TK_MOD){
     Token op = lx.tok;
     next_tok();
-    unary();
-    emit(op==TK_MUL?OP_MUL:op==TK_DIV?OP_DIV:OP_MOD);
+    int rstart = prog->code_size;
+    ValueType rt = unary();
+    lt = emit_binop(op==TK_MUL?OP_MUL:op==TK_DIV?OP_DIV:OP_MOD, lstart, rstart, lt, rt);
   }
+  return lt;
 }
 
-static void additive(){
-  term();
+static ValueType additive(){
+  int lstart = prog->code_size;
+  ValueType lt = term();
   while(lx.tok==TK_PLUS||lx.tok==TK_MINUS){
     Token op = lx.tok;
     next_tok();
-    term();
-    emit(op==TK_PLUS?OP_ADD:OP_SUB);
+    int rstart = prog->code_size;
+    ValueType rt = term();
+    lt = emit_binop(op==TK_PLUS?OP_ADD:OP_SUB, lstart, rstart, lt, rt);
+  }
+  return lt;
+}
+
+static ValueType shift(){
+  int lstart = prog->code_size;
+  ValueType lt = additive();
+  while(lx.tok==TK_SHL||lx.tok==TK_SHR){
+    Token op = lx.tok;
+    next_tok();
+    int rstart = prog->code_size;
+    ValueType rt = additive();
+    lt = emit_binop(op==TK_SHL?OP_SHL:OP_SHR, lstart, rstart, lt, rt);
   }
+  return lt;
 }
 
-static void relational(){
-  additive();
+static ValueType relational(){
+  int lstart = prog->code_size;
+  ValueType lt = shift();
   while(lx.tok==TK_LT||lx.tok==TK_LE||lx.tok==TK_GT||lx.tok==TK_GE){
     Token op=lx.tok; next_tok();
-    additive();
-    emit(op == TK_LT ? OP_LT : op == TK_LE ? OP_LE : op == TK_GT ? OP_GT : OP_GE);
+    int rstart = prog->code_size;
+    ValueType rt = shift();
+    lt = emit_binop(op == TK_LT ? OP_LT : op == TK_LE ? OP_LE : op == TK_GT ? OP_GT : OP_GE, lstart, rstart, lt, rt);
   }
+  return lt;
 }
 
-static void equality(){
-  relational();
+static ValueType equality(){
+  int lstart = prog->code_size;
+  ValueType lt = relational();
   while(lx.tok==TK_EQ||lx.tok==TK_NE){
     Token op=lx.tok; next_tok();
-    relational();
-    emit(op==TK_EQ?OP_EQ:OP_NE);
+    int rstart = prog->code_size;
+    ValueType rt = relational();
+    lt = emit_binop(op==TK_EQ?OP_EQ:OP_NE, lstart, rstart, lt, rt);
+  }
+  return lt;
+}
+
+// & ^ | con la precedencia de C (por debajo de la igualdad)
+static ValueType bit_and(){
+  int lstart = prog->code_size;
+  ValueType lt = equality();
+  while(lx.tok==TK_BAND){
+    next_tok();
+    int rstart = prog->code_size;
+    ValueType rt = equality();
+    lt = emit_binop(OP_BAND, lstart, rstart, lt, rt);
   }
+  return lt;
 }
 
-static void logic_and(){
-  equality();
+static ValueType bit_xor(){
+  int lstart = prog->code_size;
+  ValueType lt = bit_and();
+  while(lx.tok==TK_XOR){
+    next_tok();
+    int rstart = prog->code_size;
+    ValueType rt = bit_and();
+    lt = emit_binop(OP_XOR, lstart, rstart, lt, rt);
+  }
+  return lt;
+}
+
+static ValueType bit_or(){
+  int lstart = prog->code_size;
+  ValueType lt = bit_xor();
+  while(lx.tok==TK_BOR){
+    next_tok();
+    int rstart = prog->code_size;
+    ValueType rt = bit_xor();
+    lt = emit_binop(OP_BOR, lstart, rstart, lt, rt);
+  }
+  return lt;
+}
+
+// a && b && ... -> 0/1 con cortocircuito
+static ValueType logic_and(){
+  ValueType t = bit_or();
+  if(lx.tok!=TK_AND) return t;
+  int fails = emit_jmp_chain(OP_JMP_FALSE, 0);
   while(lx.tok==TK_AND){
-    int p = emit_jmp(OP_JMP_FALSE);
-    equality();
-    patch(p, vm.code_size);
+    next_tok();
+    bit_or();
+    fails = emit_jmp_chain(OP_JMP_FALSE, fails);
   }
+  emit_const(1);
+  int end = emit_jmp(OP_JMP);
+  patch_chain(fails, prog->code_size);
+  emit_const(0);
+  patch(end, prog->code_size);
+  return T_I32;
 }
 
-static void expr(){
-  logic_and();
+// a || b || ... -> 0/1 con cortocircuito
+static ValueType expr(){
+  ValueType t = logic_and();
+  if(lx.tok!=TK_OR) return t;
+  int oks = emit_jmp_chain(OP_JMP_TRUE, 0);
   while(lx.tok==TK_OR){
 	next_tok();  
-    int p = emit_jmp(OP_JMP_TRUE);
     logic_and();
-    patch(p, vm.code_size);
+    oks = emit_jmp_chain(OP_JMP_TRUE, oks);
   }
+  emit_const(0);
+  int end = emit_jmp(OP_JMP);
+  patch_chain(oks, prog->code_size);
+  emit_const(1);
+  patch(end, prog->code_size);
+  return T_I32;
 }
 
 // ---------- BLOQUES Y SCOPE ----------
-static void enter_scope(){ vm.sym.scope_level++; }
+static void enter_scope(){ cc->sym.scope_level++; }
 static void leave_scope(){
-  while(vm.sym.count>0 &&
-        vm.sym.table[vm.sym.count-1].scope_level==vm.sym.scope_level)
-    vm.sym.count--;
-  vm.sym.scope_level--;
+  while(cc->sym.count>0 &&
+        cc->sym.table[cc->sym.count-1].scope_level==cc->sym.scope_level){
+    Symbol *s = &cc->sym.table[--cc->sym.count];
+    cc->sym.bucket[s->hash % SYM_BUCKETS] = s->next + 1;   // era la cabeza
+  }
+  cc->sym.scope_level--;
 }
 
 static void stmt();
@@ -365,171 +1146,612 @@ static ValueType parse_type(){
   return T_VOID;
 }
 
+// `tipo nombre[`: solo hay arrays de enteros con ancho
+static ValueType array_of(ValueType t){
+  if(t != T_I8 && t != T_I16 && t != T_I32) syntax("array of int8/int16/int32 expected");
+  return T_ARRAY;
+}
+
 static void var_decl(){
   ValueType t = parse_type();
   if(lx.tok!=TK_ID) syntax("id expected");
   char name[32]; 
   strncpy(name,lx.id,31); 
+  name[31] = '\0';
   next_tok();
-  int si = sym_add(name, t,vm.sym.scope_level == 0 ? SYM_VAR_GLOBAL : SYM_VAR_LOCAL);
+  // dentro de una función (fp > 0) es un local del frame; fuera, global
+  int si = sym_add(name, lx.tok == TK_LB ? array_of(t) : t, cc->fp > 0 ? SYM_VAR_LOCAL : SYM_VAR_GLOBAL);
   
-  if(lx.tok==TK_ASSIGN){
+  if(lx.tok==TK_LB){   // int16 buf[n]: array nuevo de n elementos a 0
     next_tok();
     expr();
-    emit(OP_STORE_VAR);
-	emit_i(vm.sym.table[si].index | (vm.sym.table[si].kind == SYM_VAR_LOCAL ? 0x80000000 : 0));
+    if(lx.tok!=TK_RB) syntax("expected ]");
+    next_tok();
+    emit(OP_ARR_NEW);
+    emit(t);
+    emit_store(&cc->sym.table[si]);
+  } else if(lx.tok==TK_ASSIGN){
+    next_tok();
+    coerce(expr(), t);
+    emit_store(&cc->sym.table[si]);
+  } else if(cc->fp > 0 && is_int_type(t)){
+    // el slot del frame arrastra lo que hubiera: se inicializa a 0 del tipo
+    emit_const(0);
+    coerce(T_I32, t);
+    emit_store(&cc->sym.table[si]);
   }
   if(lx.tok==TK_SEMI) next_tok(); else syntax(";");
 }
 
-static void func_decl() {
-  next_tok(); // consume func
-  ValueType ret_type = T_VOID;  // Default void
-  if (lx.tok == KW_INT32 || lx.tok == KW_BOOL) {  // Optional return type
-    ret_type = parse_type();
-  }
-  if (lx.tok != TK_ID) syntax("func name");
-  char fname[32]; 
-  strncpy(fname, lx.id, 31); 
-  next_tok();
-  
-  int fi = vm.func_count;
-  sym_add(fname, ret_type, SYM_FUNC);
-  Function *f = &vm.funcs[fi];
-  strncpy(f->name, fname, sizeof(f->name) - 1);
-  f->code_start = vm.code_size;
-  f->ret_type = ret_type;
-
+// Parámetros de fi, de '(' a ')': fijan su firma y, con `declare`, son
+// además los primeros símbolos del frame actual
+static void func_params(int fi, int declare){
   if (lx.tok != TK_LP) syntax("(");
   next_tok();
-  vm.fp++;  // Push new frame for params/locals
-  vm.frames[vm.fp].local_count = 0;
-  vm.frames[vm.fp].param_count = 0;
-  vm.frames[vm.fp].func_index = fi;
-  
-  enter_scope();
   int argc = 0;
   while (lx.tok != TK_RP) {
     ValueType t = parse_type();
     if (lx.tok != TK_ID) syntax("param id");
-    sym_add(lx.id, t, SYM_PARAM);
-    argc++;
+    if (argc >= MAX_PARAM) syntax("too many params");
+    char pname[32];
+    strcpy(pname, lx.id);
     next_tok();
+    if (lx.tok == TK_LB) {   // int16 a[]: el array que pasen, sea del ancho que sea
+      next_tok();
+      if (lx.tok != TK_RB) syntax("expected ]");
+      next_tok();
+      t = array_of(t);
+    }
+    if (declare) sym_add(pname, t, SYM_PARAM);
+    prog->funcs[fi].param_types[argc] = t;
+    argc++;
     if (lx.tok == TK_COMMA) next_tok();
   }
-  f->param_count = argc;
+  prog->funcs[fi].param_count = argc;
   next_tok();  // Consume )
+}
+
+// Código de fi, con el lexer en su '(': parámetros, cuerpo y return
+// implícito en un frame propio
+static void func_body(int fi){
+  prog->funcs[fi].code_start = prog->code_size;
+  cc->fp++;  // Push new frame for params/locals
+  cc->frames[cc->fp].local_count = 0;
+  cc->frames[cc->fp].param_count = 0;
+  cc->frames[cc->fp].func_index = fi;
+  cc->frames[cc->fp].inline_slots = 0;
+  int funcs = prog->func_count;
+  LoopCtx *outer_loop = cur_loop;
+  cur_loop = NULL;
   
+  enter_scope();
+  func_params(fi, 1);
   block();
   leave_scope();
-  vm.fp--;
+  // el cuerpo pudo declarar funciones y mover prog->funcs: no guardar punteros
+  prog->funcs[fi].local_count = cc->frames[cc->fp].local_count;
+  cc->fp--;
+  cur_loop = outer_loop;
   
+  // return implícito: toda llamada deja exactamente un valor
+  emit_const(0);
   emit(OP_RET);
+  if (prog->func_count == funcs) cc->fn[fi].inline_len = inline_size(fi);
+}
+
+// Salta el cuerpo de una función perezosa, con el lexer en su '{'. Sin
+// compilarlo solo se puede comprobar que se tokeniza entero y que (), []
+// y {} cierran en orden, y eso se comprueba siempre: un cuerpo que no se
+// llama no pasa de largo por estar mal cerrado.
+static void skip_body(void){
+  uint8_t open[64];   // TK_LP, TK_LB o TK_LC abiertos
+  int n = 0;
+  do {
+    if (lx.tok == TK_LP || lx.tok == TK_LB || lx.tok == TK_LC) {
+      if (n == (int)sizeof(open)) syntax("nested too deep");
+      open[n++] = lx.tok;
+    } else if (lx.tok == TK_RP || lx.tok == TK_RB || lx.tok == TK_RC) {
+      if (open[--n] != lx.tok - 1)   // cada cierre va justo detrás de su apertura
+        syntax(open[n] == TK_LP ? "expected )" : open[n] == TK_LB ? "expected ]" : "expected }");
+    } else if (lx.tok == TK_END) syntax("expected }");
+    next_tok();
+  } while (n > 0);
+}
+
+static void func_decl() {
+  next_tok(); // consume func
+  ValueType ret_type = T_VOID;  // Default void
+  if (lx.tok == KW_INT8 || lx.tok == KW_INT16 || lx.tok == KW_INT32 || lx.tok == KW_BOOL) {  // Optional return type
+    ret_type = parse_type();
+  }
+  if (lx.tok != TK_ID) syntax("func name");
+  char fname[32]; 
+  strncpy(fname, lx.id, 31); 
+  fname[31] = '\0';
+  next_tok();
+  
+  if (cc->fp + 1 >= MAX_FRAMES) syntax("funcs nested too deep");
+  int fi = prog->func_count;
+  sym_add(fname, ret_type, SYM_FUNC);
+  Function *f = &prog->funcs[fi];
+  memcpy(f->name, fname, sizeof(f->name));   // mismo tamaño, ya terminado
+  f->ret_type = ret_type;
+  FuncInfo *fn = &cc->fn[fi];
+  fn->src = lx_tok_pos();
+  fn->line = lx.line;
+  fn->syms = cc->sym.count;
+
+  if (minic_lazy && cc->fp == 0 && cc->sym.scope_level == 0 && lx_can_seek()) {
+    // perezosa: ahora solo la firma; el cuerpo se salta hasta que se llame
+    func_params(fi, 0);
+    if (lx.tok != TK_LC) syntax("expected {");
+    skip_body();
+    fn->state = strcmp(fname, "main") ? FN_LAZY : FN_CALLED;   // main: raíz
+    prog->funcs[fi].code_start = -1;
+    return;
+  }
+  // el cuerpo se emite en línea con el código de nivel superior: saltarlo
+  fn->begin = prog->code_size;
+  int skip = emit_jmp(OP_JMP);
+  func_body(fi);
+  fn->end = prog->code_size;
+  patch(skip, prog->code_size);
+}
+
+// Cuerpo perezoso de fi. Antes, las funciones perezosas que nombra, para
+// que estén compiladas (y se puedan expandir en línea) cuando se las
+// llame; si al final nadie las llama strip_dead_funcs() las quita.
+// Se compila tras todo el nivel superior, pero como en su sitio: los
+// globals y funciones declarados después de ella no se ven.
+static void compile_lazy(int fi){
+  FuncInfo *fn = &cc->fn[fi];
+  uint8_t named[MAX_FUNCS / 8 + 1] = { 0 };
+  int hide_from = cc->sym.hide_from, hide_to = cc->sym.hide_to;
+  cc->sym.hide_from = fn->syms;
+  cc->sym.hide_to = cc->sym.count;   // aquí solo hay símbolos de nivel superior
+  fn->state = FN_COMPILED;
+  lx_seek(fn->src, fn->line);
+  next_tok();
+  for (int depth = 0; ; next_tok()) {
+    if (lx.tok == TK_LC) depth++;
+    else if (lx.tok == TK_RC && --depth == 0) break;
+    else if (lx.tok == TK_END) syntax("expected }");
+    else if (lx.tok == TK_ID) {
+      int si = sym_lookup_h(lx.id, lx.id_hash);
+      const Symbol *s = si >= 0 ? &cc->sym.table[si] : NULL;
+      if (s && s->kind == SYM_FUNC && cc->fn[s->index].state != FN_COMPILED)
+        named[s->index >> 3] |= 1 << (s->index & 7);
+    }
+  }
+  for (int i = 0; i < prog->func_count; i++)
+    if ((named[i >> 3] >> (i & 7) & 1) && cc->fn[i].state != FN_COMPILED) compile_lazy(i);
+
+  fn->begin = prog->code_size;
+  lx_seek(fn->src, fn->line);
+  next_tok();
+  cc->line = fn->line;
+  line_mark();
+  func_body(fi);
+  fn->end = prog->code_size;
+  cc->sym.hide_from = hide_from;
+  cc->sym.hide_to = hide_to;
+}
+
+// Compila, detrás del nivel superior, los cuerpos perezosos que algo
+// llama (y los que llamen estos a su vez)
+static void compile_called(void){
+  int skip = 0;
+  for (int fi = 0; fi < prog->func_count; fi++) {
+    if (cc->fn[fi].state != FN_CALLED) continue;
+    if (!skip) skip = emit_jmp(OP_JMP);   // el nivel superior acaba en el OP_HALT
+    compile_lazy(fi);
+  }
+  if (!skip) return;
+  patch(skip, prog->code_size);
+  cc->line = 0;
+  line_mark();
 }
 
 // ---------- STATEMENTS ----------
+// Compila `parse` y descarta el código generado (rama muerta). Los
+// break/continue pendientes que caían dentro se sueltan de sus listas.
+// Si la rama declaraba funciones su código se conserva.
+static void dead_code(void (*parse)(void)){
+  int start = prog->code_size;
+  int funcs = prog->func_count;
+  parse();
+  if(prog->func_count != funcs) return;
+  for(LoopCtx *l = cur_loop; l; l = l->prev){
+    while(l->breaks && l->breaks >= start) l->breaks = RD16(prog->code + l->breaks);
+    while(l->conts && l->conts >= start) l->conts = RD16(prog->code + l->conts);
+  }
+  prog->code_size = start;
+  line_mark();   // fuera también las líneas de la rama
+}
+
 static void while_stmt(){
     next_tok(); // consume while
-    int loop_start = vm.code_size;
+    LoopCtx loop = { prog->code_size, 0, 0, cur_loop };
 
+    int32_t cv;
+    int jfalse = 0;
     expr();
-    int jfalse = emit_jmp(OP_JMP_FALSE);
-
-    Frame *f = &vm.frames[vm.fp];
-    int prev_loop_start = f->loop_start;
-    int prev_loop_end   = f->loop_end;
-
-    f->loop_start = loop_start;
-    f->loop_end   = 0;       // temporal, se parchea después
-    int break_stack[MAX_STACK];  // para múltiples breaks
-    int break_count = 0;
-
-    // bloque del loop
-    while(lx.tok != TK_END && lx.tok != TK_RC){
-        if(lx.tok == KW_BREAK){
-            next_tok(); if(lx.tok == TK_SEMI) next_tok();
-            int br_pos = emit_jmp(OP_JMP);
-            break_stack[break_count++] = br_pos;
-        } else if(lx.tok == KW_CONTINUE){
-            next_tok(); if(lx.tok == TK_SEMI) next_tok();
-            emit(OP_JMP);
-            emit_i(loop_start);
-        } else {
-            stmt();
-        }
+    if(const_at(loop.start, prog->code_size, &cv)){
+      prog->code_size = loop.start;   // while(1): sin test; while(0): nada
+      if(!cv){
+        cur_loop = &loop;
+        dead_code(block);
+        cur_loop = loop.prev;
+        return;
+      }
+
+    } else {
+      jfalse = emit_jmp(OP_JMP_FALSE);
     }
 
-    int loop_end = vm.code_size;
-    patch(jfalse, loop_end);
-    for(int i=0;i<break_count;i++) patch(break_stack[i], loop_end);
+    cur_loop = &loop;
+    block();
+    cur_loop = loop.prev;
 
     // jump al inicio del loop
-    emit(OP_JMP); emit_i(loop_start);
+    emit(OP_JMP); emit_u16(loop.start);
 
-    f->loop_start = prev_loop_start;
-    f->loop_end   = prev_loop_end;
+    if(jfalse) patch(jfalse, prog->code_size);
+    patch_chain(loop.breaks, prog->code_size);
+    patch_chain(loop.conts, loop.start);
 }
 
+// Entrada del despacho de un switch: salto a `dst`, o fuera del switch
+// (a la lista `breaks`) si dst < 0
+static void case_jmp(int dst, int *breaks){
+  if(dst >= 0){ emit(OP_JMP); emit_u16(dst); }
+  else *breaks = emit_jmp_chain(OP_JMP, *breaks);
+}
 
-static void if_stmt(){
-  next_tok();
-  expr();
-  int jf = emit_jmp(OP_JMP_FALSE);
+// Despacho de los n casos `cs` (y `def`, -1 = sin default). Si los valores
+// ocupan al menos un tercio de su rango, tabla indexada (O(1)); si no,
+// búsqueda binaria sobre los casos ordenados (O(log n)).
+static void emit_switch_dispatch(SwitchCase *cs, int n, int def, int *breaks){
+  for(int i = 1; i < n; i++){   // pocos casos: inserción
+    SwitchCase c = cs[i];
+    int j = i;
+    for(; j > 0 && cs[j - 1].value > c.value; j--) cs[j] = cs[j - 1];
+    cs[j] = c;
+  }
+  int64_t range = n ? (int64_t)cs[n - 1].value - cs[0].value + 1 : 0;
+  if(n && range <= 3 * n){
+    emit(OP_JMP_TABLE);
+    emit_i32(cs[0].value);
+    emit_u16((uint16_t)range);
+    for(int64_t v = cs[0].value, i = 0; i < n; v++)
+      case_jmp(cs[i].value == v ? cs[i++].ip : def, breaks);
+  } else {
+    emit(OP_JMP_SEARCH);
+    emit_u16((uint16_t)n);
+    for(int i = 0; i < n; i++){
+      emit(OP_PUSH_CONST);   // siempre 5 bytes: la VM los recorre a saltos de 8
+      emit_i32(cs[i].value);
+      case_jmp(cs[i].ip, breaks);
+    }
+  }
+  case_jmp(def, breaks);
+}
+
+// switch(e){ case k: ... default: ... }
+// Como en C, cada caso cae al siguiente y break sale del switch. El
+// despacho va al final, cuando ya se conocen todos los casos: el valor
+// se evalúa, se salta a él y desde él al caso.
+static void switch_stmt(){
+  next_tok(); // consume switch
+  if(expr() == T_STRING) syntax("switch on string");
+  int disp = emit_jmp(OP_JMP);
+  if(lx.tok!=TK_LC) syntax("expected {");
+  next_tok();
+  LoopCtx sw = { -1, 0, 0, cur_loop };
+  int base = cc->case_count, def = -1;
+  cur_loop = &sw;
+  enter_scope();
+  while(lx.tok!=TK_RC && lx.tok!=TK_END){
+    if(lx.tok==KW_CASE){
+      next_tok();
+      int start = prog->code_size;
+      int32_t v;
+      expr();
+      if(!const_at(start, prog->code_size, &v)) syntax("case not constant");
+      prog->code_size = start;
+      for(int i = base; i < cc->case_count; i++)
+        if(cc->cases[i].value == v) syntax("duplicate case");
+      if(cc->case_count >= MAX_CASES) syntax("too many cases");
+      cc->cases[cc->case_count].value = v;
+      cc->cases[cc->case_count++].ip = prog->code_size;
+    } else if(lx.tok==KW_DEFAULT){
+      next_tok();
+      if(def >= 0) syntax("duplicate default");
+      def = prog->code_size;
+    } else {
+      if(cc->case_count == base && def < 0) syntax("case expected");
+      stmt();
+      continue;
+    }
+    if(lx.tok!=TK_COLON) syntax("expected :");
+    next_tok();
+  }
+  if(lx.tok!=TK_RC) syntax("expected }");
+  next_tok();
+  leave_scope();
+  cur_loop = sw.prev;
+
+  sw.breaks = emit_jmp_chain(OP_JMP, sw.breaks);   // fin del último caso
+  patch(disp, prog->code_size);
+  emit_switch_dispatch(cc->cases + base, cc->case_count - base, def, &sw.breaks);
+  cc->case_count = base;
+  patch_chain(sw.breaks, prog->code_size);
+}
+
+static void else_part(){
+  if(lx.tok==KW_IF) stmt();   // else if (con su propia línea)
+  else block();
+}
+
+static void if_stmt(){
+  next_tok();
+  int cstart = prog->code_size;
+  int32_t cv;
+  expr();
+  if(const_at(cstart, prog->code_size, &cv)){
+    // condición conocida en compilación: solo se emite la rama viva
+    prog->code_size = cstart;
+    if(cv) block(); else dead_code(block);
+    if(lx.tok==KW_ELSE){
+      next_tok();
+      if(cv) dead_code(else_part); else else_part();
+    }
+    return;
+  }
+  int jf = emit_jmp(OP_JMP_FALSE);
   block();
   if(lx.tok==KW_ELSE){
     int je = emit_jmp(OP_JMP);
-    patch(jf, vm.code_size);
+    patch(jf, prog->code_size);
     next_tok();
-    block();
-    patch(je, vm.code_size);
+    else_part();
+    patch(je, prog->code_size);
   } else {
-    patch(jf, vm.code_size);
+    patch(jf, prog->code_size);
   }
 }
 
 static void return_stmt(){
+  if(cc->fp <= 0) syntax("return outside func");
   next_tok();
   if(lx.tok!=TK_SEMI){
-    expr();
+    cc->last_call = -1;
+    ValueType t = expr();
+    coerce(t, (ValueType)prog->funcs[cc->frames[cc->fp].func_index].ret_type);
+    // return f(...): lo último es la llamada, que puede ocupar este frame.
+    // El RET queda detrás (no se alcanza).
+    if(minic_opt && cc->last_call == prog->code_size - 2)
+      prog->code[cc->last_call] = OP_TAIL_CALL;
   }else{
-	  //emit(OP_PUSH_CONST);
-	  //emit_i(0);
+	  emit_const(0);
   }
   emit(OP_RET);
   if(lx.tok==TK_SEMI) next_tok();
 }
 
-static void assign_or_expr_stmt(){
-  if(lx.tok!=TK_ID){ expr(); if(lx.tok==TK_SEMI) next_tok(); return; }
-  char name[32]; strncpy(name,lx.id,31);
+static int is_assign_op(Token op){
+  return op==TK_ASSIGN || op==TK_ADD_ASSIGN || op==TK_SUB_ASSIGN ||
+         op==TK_MUL_ASSIGN || op==TK_DIV_ASSIGN || op==TK_MOD_ASSIGN ||
+         op==TK_AND_ASSIGN || op==TK_OR_ASSIGN || op==TK_XOR_ASSIGN ||
+         op==TK_INC || op==TK_DEC;
+}
+
+// Valor a guardar en `x op e` o x++/x-- (lx en op). Salvo con '=', el
+// valor actual de x (tipo lt) ya está apilado desde lstart.
+static ValueType assign_value(Token op, int lstart, ValueType lt){
   next_tok();
-  int si = sym_lookup(name);
-  if(si<0) syntax("unknown id");
-  if(lx.tok==TK_ASSIGN){
+  int rstart = prog->code_size;
+  if(op==TK_INC || op==TK_DEC){   // x++;  ->  x += 1 (sin dejar valor)
+    emit_const(1);
+    return emit_binop(op == TK_INC ? OP_ADD : OP_SUB, lstart, rstart, lt, T_I32);
+  }
+  ValueType t = expr();
+  switch(op){   // x op= e  ->  x = x op e
+    case TK_ADD_ASSIGN: t = emit_binop(OP_ADD, lstart, rstart, lt, t); break;
+    case TK_SUB_ASSIGN: t = emit_binop(OP_SUB, lstart, rstart, lt, t); break;
+    case TK_MUL_ASSIGN: t = emit_binop(OP_MUL, lstart, rstart, lt, t); break;
+    case TK_DIV_ASSIGN: t = emit_binop(OP_DIV, lstart, rstart, lt, t); break;
+    case TK_MOD_ASSIGN: t = emit_binop(OP_MOD, lstart, rstart, lt, t); break;
+    case TK_AND_ASSIGN: t = emit_binop(OP_BAND, lstart, rstart, lt, t); break;
+    case TK_OR_ASSIGN:  t = emit_binop(OP_BOR, lstart, rstart, lt, t); break;
+    case TK_XOR_ASSIGN: t = emit_binop(OP_XOR, lstart, rstart, lt, t); break;
+    default: break;
+  }
+  return t;
+}
+
+// Asignación, x++/x-- o expresión que empieza por un identificador, sin
+// el ';' (también la usan la inicialización y el paso de un for)
+static void assign_or_expr(){
+  char name[32]; strncpy(name,lx.id,31); name[31] = '\0';
+  uint32_t h = lx.id_hash;
+  next_tok();
+  Token op = lx.tok;
+  if(op==TK_LB){   // a[i] op= e  ->  [a, i, a, i] ARR_LOAD e op ARR_STORE
+    Symbol *s = var_lookup(name, h);
+    if(s->type != T_ARRAY) syntax("not an array");
+    emit_load(s);
     next_tok();
     expr();
-    emit(OP_STORE_VAR);
-    emit_i(vm.sym.table[si].index | (vm.sym.table[si].kind == SYM_VAR_LOCAL ? 0x80000000 : 0));
+    if(lx.tok!=TK_RB) syntax("expected ]");
+    next_tok();
+    op = lx.tok;
+    if(!is_assign_op(op)) syntax("assignment expected");
+    int lstart = prog->code_size;
+    if(op!=TK_ASSIGN){
+      emit(OP_DUP2);
+      emit(OP_ARR_LOAD);
+    }
+    if(assign_value(op, lstart, T_I32) == T_ARRAY) syntax("array type mismatch");
+    emit(OP_ARR_STORE);   // se trunca al ancho del array
+
+  } else if(is_assign_op(op)){
+    Symbol *s = var_lookup(name, h);
+    int lstart = prog->code_size;
+    if(op!=TK_ASSIGN) emit_load(s);
+    coerce(assign_value(op, lstart, s->type), s->type);
+    emit_store(s);
+
+  } else {
+    // expresión que empieza por el identificador (p.ej. una llamada)
+    strcpy(pend_id, name);
+    pend_hash = h;
+    expr();
+    emit(OP_POP);
   }
+}
+
+static void assign_or_expr_stmt(){
+  assign_or_expr();
   if(lx.tok==TK_SEMI) next_tok();
 }
 
-static void stmt(){
+// Cláusula de inicialización o paso de un for: sentencia simple sin ';'
+static void for_clause(){
+  if(lx.tok==TK_ID){
+    assign_or_expr();
+  } else if(lx.tok!=TK_SEMI && lx.tok!=TK_RP){
+    expr();
+    emit(OP_POP);
+  }
+}
+
+// ¿El for con condición en [cs, ce) y paso `step` (n bytes) se cierra con
+// un OP_FOR_LT_*? Cabe si la condición es `x < k`, `x <= k` o `x < y` y el
+// paso es `x += k` con x int32 y k > 0 (también ++x y x++). Si cabe lo
+// emite con destino `body` y devuelve 1.
+static int emit_for_fused(int cs, int ce, const uint8_t *step, int n, int body){
+  const uint8_t *c = prog->code;
+  uint8_t cmp = c[ce - 1];
+  if(ce - cs < 4 || !is_push_var(c[cs]) || (cmp != OP_LT && cmp != OP_LE)) return 0;
+  // paso: PUSH_VAR x; PUSH_I8 k; ADD_I32|SUB_I32; [DUP;] STORE_VAR x; [POP]
+  if(n < 7 || step[0] != c[cs] || step[1] != c[cs + 1] || step[2] != OP_PUSH_I8 ||
+     !is_i32_add(step[4]))
+    return 0;
+  if(!(n == 7 && same_var(step, step + 5)) &&
+     !(n == 9 && step[5] == OP_DUP && same_var(step, step + 6) && step[8] == OP_POP))
+    return 0;
+  int32_t k = (int8_t)step[3] * add_sign(step[4]);
+  if(k <= 0 || k > INT8_MAX) return 0;
+  uint8_t x = slot_at(c + cs);
+
+  int32_t lim;
+  if(cmp == OP_LT && ce - cs == 5 && is_push_var(c[cs + 2])){
+    uint8_t y = slot_at(c + cs + 2);
+    emit(OP_FOR_LT_VAR); emit_u16(body);
+    emit(x); emit((uint8_t)k); emit(y);
+    return 1;
+  }
+  if(!const_at(cs + 2, ce - 1, &lim)) return 0;
+  if(cmp == OP_LE){                        // x <= k  ->  x < k + 1
+    if(lim == INT32_MAX) return 0;
+    lim++;
+  }
+  emit(OP_FOR_LT_CONST); emit_u16(body);
+  emit(x); emit((uint8_t)k); emit_i32(lim);
+  return 1;
+}
+
+// for(init; cond; paso) { ... }
+// El paso se compila antes que el cuerpo pero va detrás: se copia aparte
+// y se vuelve a emitir al final (reubicando sus saltos internos). Si el
+// bucle es contado (ver emit_for_fused()) paso, condición y salto atrás
+// se cierran con una sola instrucción.
+static void for_stmt(){
+  next_tok();   // consume for
+  if(lx.tok!=TK_LP) syntax("expected (");
+  next_tok();
+  enter_scope();   // lo declarado en init es del for
+  if(lx.tok==KW_INT8 || lx.tok==KW_INT16 || lx.tok==KW_INT32 ||
+     lx.tok==KW_BOOL || lx.tok==KW_STRING){
+    var_decl();   // ya consume el ';'
+  } else {
+    for_clause();
+    if(lx.tok!=TK_SEMI) syntax(";");
+    next_tok();
+  }
+
+  LoopCtx loop = { prog->code_size, 0, 0, cur_loop };
+  int32_t cv = 1;
+  int known = 1;   // sin condición: for(;;)
+  if(lx.tok!=TK_SEMI){
+    expr();
+    known = const_at(loop.start, prog->code_size, &cv);
+    if(known) prog->code_size = loop.start;
+  }
+  int cend = prog->code_size;
+  if(lx.tok!=TK_SEMI) syntax(";");
+  next_tok();
+
+  uint8_t step[MAX_FOR_STEP];
+  for_clause();
+  int slen = prog->code_size - cend;
+  if(slen > MAX_FOR_STEP) syntax("for step too long");
+  memcpy(step, prog->code + cend, slen);
+  prog->code_size = cend;
+  if(lx.tok!=TK_RP) syntax("expected )");
+  next_tok();
+
+  if(!cv){   // for(...; 0; ...): solo queda la inicialización
+    cur_loop = &loop;
+    dead_code(block);
+    cur_loop = loop.prev;
+    leave_scope();
+    return;
+  }
+  int jfalse = known ? 0 : emit_jmp(OP_JMP_FALSE);
+  int body = prog->code_size;
+  cur_loop = &loop;
+  block();
+  cur_loop = loop.prev;
+
+  int cont = prog->code_size;
+  if(known || !emit_for_fused(loop.start, cend, step, slen, body)){
+    // saltos internos del paso (&&, ||): destinos dentro de [cend, cend+slen]
+    for(int pc = 0; pc < slen; pc += 1 + op_len[step[pc]])
+      if(op_is_jump(step[pc]) && RD16(step + pc + 1) >= cend){
+        int dst = RD16(step + pc + 1) - cend + cont;
+        step[pc + 1] = dst & 0xFF;
+        step[pc + 2] = dst >> 8;
+      }
+    for(int i = 0; i < slen; i++) emit(step[i]);
+    emit(OP_JMP); emit_u16(loop.start);
+  }
+
+  if(jfalse) patch(jfalse, prog->code_size);
+  patch_chain(loop.breaks, prog->code_size);
+  patch_chain(loop.conts, cont);
+  leave_scope();
+}
+
+static void stmt_kind(){
   switch(lx.tok){
     case KW_IF: if_stmt(); return;
     case KW_WHILE: while_stmt(); return;
+    case KW_FOR: for_stmt(); return;
+    case KW_SWITCH: switch_stmt(); return;
     case KW_RETURN: return_stmt(); return;
 	case KW_BREAK: {
-            if(vm.fp < 0 || vm.frames[vm.fp].loop_end == 0) syntax("break outside loop");
-            emit(OP_JMP);
-            emit_i(vm.frames[vm.fp].loop_end);
+            if(!cur_loop) syntax("break outside loop");
+            cur_loop->breaks = emit_jmp_chain(OP_JMP, cur_loop->breaks);
             next_tok(); if(lx.tok==TK_SEMI) next_tok();
             return;
         }
         case KW_CONTINUE: {
-            if(vm.fp < 0 || vm.frames[vm.fp].loop_start == 0) syntax("continue outside loop");
-            emit(OP_JMP);
-            emit_i(vm.frames[vm.fp].loop_start);
+            LoopCtx *l = cur_loop;
+            while(l && l->start < 0) l = l->prev;   // saltar los switch
+            if(!l) syntax("continue outside loop");
+            l->conts = emit_jmp_chain(OP_JMP, l->conts);
             next_tok(); if(lx.tok==TK_SEMI) next_tok();
             return;
         }
@@ -540,340 +1762,1507 @@ static void stmt(){
 	case KW_STRING: var_decl(); return;
     case KW_FUNC: func_decl(); return;
     case TK_LC: block(); return;
-	case TK_ID:
-	  // Check if assign or expr (call)
-      /*if (lx.src[lx.pos] == '=') {
-        stmt();
-      } else {*/
-        expr();
-        if (lx.tok == TK_SEMI) next_tok();
-      //}
+	case TK_ID: assign_or_expr_stmt(); return;
+    case TK_INC: case TK_DEC: case TK_LP: case TK_NUM:
+    case TK_STRING: case TK_MINUS: case TK_NOT:
+      expr();
+      emit(OP_POP);
+      if (lx.tok == TK_SEMI) next_tok();
       return;
+    case TK_SEMI: next_tok(); return;
     default: syntax("bad stmt"); return;
   }
 }
 
-// ---------- EJECUCIÓN ----------
-static int32_t value_to_i32(Value v) {
-  switch (v.type) {
-    case T_I8: return v.i8;
-	case T_I16: return v.i16;
-	case T_I32: return v.i32;
-    case T_BOOL: return v.boolean;
-    default: return 0;  // Error handling TBD
+// Cada sentencia apunta su línea en la tabla de líneas; al volver, lo que
+// emita después la sentencia que la contiene (p.ej. el salto atrás de un
+// while) vuelve a ser de la línea de esta.
+static void stmt(){
+  int outer = cc->line;
+  cc->line = lx.line;
+  line_mark();
+  stmt_kind();
+  cc->line = outer;
+  line_mark();
+}
+
+// ---------- OPTIMIZADOR PEEPHOLE ----------
+// Pasada posterior a la compilación sobre prog->code: reescribe secuencias
+// frecuentes en superinstrucciones y compacta el código en el sitio
+// (nunca crece), corrigiendo después los destinos de salto y los
+// code_start de las funciones.
+
+static OpCode cmp_jmp_false(uint8_t op){
+  switch(op){
+    case OP_EQ: return OP_EQ_JMP_FALSE;
+    case OP_NE: return OP_NE_JMP_FALSE;
+    case OP_LT: return OP_LT_JMP_FALSE;
+    case OP_GT: return OP_GT_JMP_FALSE;
+    case OP_LE: return OP_LE_JMP_FALSE;
+    case OP_GE: return OP_GE_JMP_FALSE;
+    default:    return OP_NOP;
+  }
+}
+
+static void peephole(void){
+  uint8_t *c = prog->code;
+  int n = prog->code_size;
+  uint8_t *target = (uint8_t *)calloc(n + 1, 1);
+  uint16_t *map = (uint16_t *)malloc((n + 1) * sizeof(uint16_t));
+  if(!target || !map){ free(target); free(map); return; }
+
+  // 1) destinos de salto: una secuencia solo puede fusionarse si ninguna
+  //    de sus instrucciones interiores es destino. Los inicios de línea
+  //    cuentan como destinos: así ninguna fusión cruza dos líneas.
+  for(int pc = 0; pc < n; pc += 1 + op_len[c[pc]])
+    if(op_is_jump(c[pc])) target[RD16(c + pc + 1)] = 1;
+  for(int i = 0; i < prog->func_count; i++)
+    if(prog->funcs[i].code_start >= 0) target[prog->funcs[i].code_start] = 1;
+  for(int i = 0; i < prog->line_count; i++) target[prog->lines[i].ip] = 1;
+
+  #define IS(p, o) ((p) < n && c[p] == (uint8_t)(o) && !target[p])
+  #define FITS8(k) ((k) >= INT8_MIN && (k) <= INT8_MAX)
+
+  // 2) reescritura; w <= r siempre, y cada patrón lee sus operandos
+  //    antes de escribir
+  int r = 0, w = 0;
+  while(r < n){
+    uint8_t op = c[r];
+    int p1 = r + 1 + op_len[op];
+    map[r] = w;
+
+    // PUSH_VAR x; PUSH_I8 k; ADD|SUB; [DUP;] STORE_VAR x; [POP]
+    if(is_push_var(op) && IS(p1, OP_PUSH_I8) && p1 + 2 < n && !target[p1 + 2] && add_sign(c[p1 + 2])){
+      int32_t k = (int8_t)c[p1 + 1] * add_sign(c[p1 + 2]);
+      uint8_t inc = is_i32_add(c[p1 + 2]) ? OP_INC_VAR_I32 : OP_INC_VAR;
+      uint8_t ld[2] = { c[r], c[r + 1] };
+      uint8_t x = slot_at(ld);
+      int p3 = p1 + 3;
+      if(FITS8(k) && p3 + 1 < n && !target[p3] && same_var(ld, c + p3)){   // x += k;
+        c[w++] = inc; c[w++] = x; c[w++] = (uint8_t)k;
+        r = p3 + 2;
+        continue;
+      }
+      if(FITS8(k) && IS(p3, OP_DUP) && p3 + 2 < n && !target[p3 + 1] && same_var(ld, c + p3 + 1)){
+        int pop = IS(p3 + 3, OP_POP);
+        c[w++] = inc; c[w++] = x; c[w++] = (uint8_t)k;
+        if(!pop){ c[w++] = ld[0]; c[w++] = ld[1]; }          // ++x como valor
+        r = p3 + 3 + pop;
+        continue;
+      }
+    }
+    // PUSH_VAR a; PUSH_VAR b
+    if(is_push_var(op) && p1 < n && !target[p1] && is_push_var(c[p1])){
+      uint8_t a = slot_at(c + r), b = slot_at(c + p1);
+      c[w++] = OP_PUSH_VAR_PUSH_VAR; c[w++] = a; c[w++] = b;
+      r = p1 + 2;
+      continue;
+    }
+    // DUP; STORE_VAR x; POP  ->  STORE_VAR x
+    if(op == OP_DUP && (IS(p1, OP_STORE_GLOBAL) || IS(p1, OP_STORE_LOCAL)) && IS(p1 + 2, OP_POP)){
+      uint8_t st = c[p1], x = c[p1 + 1];
+      c[w++] = st; c[w++] = x;
+      r = p1 + 3;
+      continue;
+    }
+    // PUSH_I8 k; ADD|SUB  ->  ADD_CONST ±k
+    if(op == OP_PUSH_I8 && p1 < n && !target[p1] && add_sign(c[p1]) &&
+       FITS8((int8_t)c[r + 1] * add_sign(c[p1]))){
+      int32_t k = (int8_t)c[r + 1] * add_sign(c[p1]);
+      c[w++] = is_i32_add(c[p1]) ? OP_ADD_CONST_I32 : OP_ADD_CONST;
+      c[w++] = (uint8_t)k;
+      r = p1 + 1;
+      continue;
+    }
+    // CMP; JMP_FALSE L  ->  CMP_JMP_FALSE L
+    if(cmp_jmp_false(op) != OP_NOP && IS(p1, OP_JMP_FALSE)){
+      uint8_t l0 = c[p1 + 1], l1 = c[p1 + 2];
+      c[w++] = cmp_jmp_false(op); c[w++] = l0; c[w++] = l1;
+      r = p1 + 3;
+      continue;
+    }
+    // sin patrón: copiar la instrucción tal cual
+    for(int i = r; i < p1; i++) c[w++] = c[i];
+    r = p1;
   }
+  map[n] = w;
+  #undef IS
+  #undef FITS8
+
+  // 3) reubicar saltos, entradas de función y líneas
+  for(int pc = 0; pc < w; pc += 1 + op_len[c[pc]])
+    if(op_is_jump(c[pc])){
+      int dst = map[RD16(c + pc + 1)];
+      c[pc + 1] = dst & 0xFF;
+      c[pc + 2] = dst >> 8;
+    }
+  for(int i = 0; i < prog->func_count; i++)
+    if(prog->funcs[i].code_start >= 0) prog->funcs[i].code_start = map[prog->funcs[i].code_start];
+  for(int i = 0; i < prog->line_count; i++)
+    prog->lines[i].ip = map[prog->lines[i].ip];
+  prog->code_size = w;
+
+  free(target);
+  free(map);
+}
+
+// ---------- FUNCIONES MUERTAS ----------
+// Con minic_lazy, pasada sobre el programa ya compilado (antes de
+// peephole() y de guardarlo en caché): quita el código de las funciones
+// que no se alcanzan desde el nivel superior ni desde main(), p.ej. las
+// que solo llamaba una rama muerta. Su entrada de prog->funcs se queda
+// (los índices de OP_CALL no cambian) con code_start = -1.
+
+// Función compilada más interior que contiene `pc`; -1 = nivel superior
+static int func_at(int pc){
+  int best = -1;
+  for(int i = 0; i < prog->func_count; i++){
+    const Function *f = &prog->funcs[i];
+    if(cc->fn[i].state == FN_COMPILED && f->code_start <= pc && pc < cc->fn[i].end &&
+       (best < 0 || f->code_start > prog->funcs[best].code_start))
+      best = i;
+  }
+  return best;
 }
 
-static Value i32_to_value(int32_t i, ValueType t) {
+static void strip_dead_funcs(void){
+  uint8_t *c = prog->code;
+  int n = prog->code_size, dead_funcs = 0;
+  uint8_t live[MAX_FUNCS] = { 0 };
+  int fm = minic_func(prog, "main");
+  if(fm >= 0) live[fm] = 1;
+  for(int changed = 1; changed; ){
+    changed = 0;
+    for(int pc = 0; pc < n; pc += 1 + op_len[c[pc]]){
+      if((c[pc] != OP_CALL && c[pc] != OP_TAIL_CALL) || live[c[pc + 1]]) continue;
+      int owner = func_at(pc);
+      if(owner < 0 || live[owner]){
+        live[c[pc + 1]] = 1;
+        changed = 1;
+      }
+    }
+  }
+  for(int i = 0; i < prog->func_count; i++)
+    if(!live[i] || cc->fn[i].state != FN_COMPILED) dead_funcs++;
+  if(!dead_funcs) return;
+
+  uint8_t *dead = (uint8_t *)calloc(n, 1);
+  uint16_t *map = (uint16_t *)malloc((n + 1) * sizeof(uint16_t));
+  if(!dead || !map){ free(dead); free(map); return; }
+  for(int i = 0; i < prog->func_count; i++)
+    if(!live[i] && cc->fn[i].state == FN_COMPILED)
+      memset(dead + cc->fn[i].begin, 1, cc->fn[i].end - cc->fn[i].begin);
+
+  // compactar como peephole(): copiar lo vivo y reubicar
+  int w = 0;
+  for(int pc = 0; pc < n; ){
+    int len = 1 + op_len[c[pc]];
+    map[pc] = w;
+    if(!dead[pc]){
+      memmove(c + w, c + pc, len);
+      w += len;
+    }
+    pc += len;
+  }
+  map[n] = w;
+  for(int pc = 0; pc < w; pc += 1 + op_len[c[pc]])
+    if(op_is_jump(c[pc])){
+      int dst = map[RD16(c + pc + 1)];
+      c[pc + 1] = dst & 0xFF;
+      c[pc + 2] = dst >> 8;
+    }
+  for(int i = 0; i < prog->func_count; i++){
+    Function *f = &prog->funcs[i];
+    f->code_start = live[i] && cc->fn[i].state == FN_COMPILED ? map[f->code_start] : -1;
+  }
+  // líneas: las de código quitado quedan en la misma ip que la siguiente,
+  // que es la que vale
+  int nl = 0;
+  for(int i = 0; i < prog->line_count; i++){
+    LineEntry e = { map[prog->lines[i].ip], prog->lines[i].line };
+    if(nl && prog->lines[nl - 1].ip == e.ip) nl--;
+    if(nl && prog->lines[nl - 1].line == e.line) continue;
+    prog->lines[nl++] = e;
+  }
+  prog->line_count = nl;
+  prog->code_size = w;
+  free(dead);
+  free(map);
+}
+
+// ---------- PROFUNDIDAD DE PILA ----------
+// Cuántos operandos llega a apilar cada función (y el nivel superior), en
+// el código final: con lo expandido en línea y tras peephole(). OP_CALL y
+// vm_enter() comprueban con ello que la ventana del llamado cabe entera.
+
+// Operandos que saca la instrucción en `c` (en *in) y cuántos deja
+static int op_stack_io(const MinicProgram *p, const uint8_t *c, int *in){
+  switch(c[0]){
+    case OP_NOP: case OP_HALT: case OP_JMP: case OP_INC_VAR: case OP_INC_VAR_I32:
+    case OP_FOR_LT_CONST: case OP_FOR_LT_VAR:
+      *in = 0; return 0;
+    case OP_PUSH_I8: case OP_PUSH_I16: case OP_PUSH_CONST: case OP_PUSH_STR:
+    case OP_PUSH_GLOBAL: case OP_PUSH_LOCAL:
+      *in = 0; return 1;
+    case OP_PUSH_VAR_PUSH_VAR:
+      *in = 0; return 2;
+    case OP_DUP:  *in = 1; return 2;
+    case OP_DUP2: *in = 2; return 4;
+    case OP_POP: case OP_STORE_GLOBAL: case OP_STORE_LOCAL: case OP_RET:
+    case OP_JMP_FALSE: case OP_JMP_TRUE: case OP_JMP_TABLE: case OP_JMP_SEARCH:
+      *in = 1; return 0;
+    case OP_EQ_JMP_FALSE: case OP_NE_JMP_FALSE: case OP_LT_JMP_FALSE:
+    case OP_GT_JMP_FALSE: case OP_LE_JMP_FALSE: case OP_GE_JMP_FALSE:
+      *in = 2; return 0;
+    case OP_NOT: case OP_NEG: case OP_ADD_CONST: case OP_ADD_CONST_I32: case OP_ARR_NEW:
+    case OP_CAST_I8: case OP_CAST_I16: case OP_CAST_I32: case OP_CAST_BOOL:
+      *in = 1; return 1;
+    case OP_ARR_STORE: *in = 3; return 0;
+    case OP_NATIVE_CALL: *in = c[2]; return 1;
+    case OP_CALL: *in = p->funcs[c[1]].param_count; return 1;
+    case OP_TAIL_CALL: *in = p->funcs[c[1]].param_count; return 0;
+    default:   // binarios (y OP_ARR_LOAD): dos operandos, un resultado
+      *in = 2; return 1;
+  }
+}
+
+// ¿Existen las variables que nombra la instrucción en `c`? `nlocals`:
+// ventana de la función que la ejecuta
+static int op_vars_ok(const MinicProgram *p, const uint8_t *c, int nlocals){
+  uint8_t s[2];
+  int n = 0;
+  switch(c[0]){
+    case OP_PUSH_GLOBAL: case OP_STORE_GLOBAL: return c[1] < p->global_count;
+    case OP_PUSH_LOCAL: case OP_STORE_LOCAL: return c[1] < nlocals;
+    case OP_INC_VAR: case OP_INC_VAR_I32: s[n++] = c[1]; break;
+    case OP_PUSH_VAR_PUSH_VAR: s[n++] = c[1]; s[n++] = c[2]; break;
+    case OP_FOR_LT_CONST: s[n++] = c[3]; break;
+    case OP_FOR_LT_VAR: s[n++] = c[3]; s[n++] = c[5]; break;
+  }
+  for(int i = 0; i < n; i++)
+    if((s[i] & ~SLOT_LOCAL) >= (s[i] & SLOT_LOCAL ? nlocals : p->global_count)) return 0;
+  return 1;
+}
+
+// Estado del recorrido, con code_size entradas por tabla
+typedef struct {
+  int16_t *depth;    // profundidad + 1 con que se llegó a cada ip; 0 = no vista
+  uint8_t *owner;    // función + 1 cuyo código es (0: el nivel superior)
+  uint16_t *work;    // ips pendientes
+  int n, size;
+} DepthWalk;
+
+// Marca `t` como alcanzado desde la función `fi` con `d` operandos; 0 si
+// ya lo estaba con otros o desde otra función (o se sale del código)
+static int depth_visit(DepthWalk *w, int fi, int t, int d){
+  if(t >= w->size) return 0;
+  if(w->depth[t]) return w->depth[t] == d + 1 && w->owner[t] == fi + 1;
+  w->depth[t] = d + 1;
+  w->owner[t] = fi + 1;
+  w->work[w->n++] = t;
+  return 1;
+}
+
+// Máximo de operandos del código de la función fi (-1: el nivel superior)
+// siguiendo todos sus caminos; -1 si algún camino saca de más, llega a
+// una instrucción con otra profundidad o a código de otra función, o usa
+// una variable que no existe
+static int code_depth(const MinicProgram *p, int fi, DepthWalk *w){
+  const uint8_t *c = p->code;
+  int max = 0, nlocals = fi < 0 ? 0 : p->funcs[fi].local_count;
+  if(!depth_visit(w, fi, fi < 0 ? 0 : p->funcs[fi].code_start, 0)) return -1;
+  while(w->n){
+    int pc = w->work[--w->n], d = w->depth[pc] - 1, in;
+    uint8_t op = c[pc];
+    int out = op_stack_io(p, c + pc, &in);
+    if(d < in || !op_vars_ok(p, c + pc, nlocals)) return -1;
+    if(fi < 0 && (op == OP_RET || op == OP_TAIL_CALL)) return -1;   // sin frame
+    d += out - in;
+    if(d > max) max = d;
+    if(d > MAX_STACK) return -1;
+    const uint8_t *e = c + pc + 1 + op_len[op];   // lo que sigue
+    int ok = 1;
+    if(op == OP_JMP_TABLE){   // n+1 OP_JMP detrás: no se ejecutan, se salta a su destino
+      for(int i = 0; i <= RD16(c + pc + 5); i++)
+        ok &= depth_visit(w, fi, RD16(e + 3 * i + 1), d);
+    } else if(op == OP_JMP_SEARCH){   // n (PUSH_CONST k; JMP) y el JMP default
+      int k = RD16(c + pc + 1);
+      for(int i = 0; i < k; i++) ok &= depth_visit(w, fi, RD16(e + 8 * i + 6), d);
+      ok &= depth_visit(w, fi, RD16(e + 8 * k + 1), d);
+    } else {
+      if(op_is_jump(op)) ok &= depth_visit(w, fi, RD16(c + pc + 1), d);
+      if(op != OP_JMP && op != OP_RET && op != OP_TAIL_CALL && op != OP_HALT)
+        ok &= depth_visit(w, fi, (int)(e - c), d);
+    }
+    if(!ok) return -1;
+  }
+  return max;
+}
+
+// Rellena max_depth de cada función; 0 si alguna ventana (o el nivel
+// superior) no cabe en la pila o el código no es coherente (ver
+// code_depth(); para una cache, tras mcb_code_ok())
+static int stack_depths(MinicProgram *p){
+  DepthWalk w = { (int16_t *)calloc(p->code_size, sizeof(int16_t)),
+                  (uint8_t *)malloc(p->code_size),
+                  (uint16_t *)malloc(p->code_size * sizeof(uint16_t)), 0, p->code_size };
+  int ok = w.depth && w.owner && w.work;
+  for(int fi = -1; ok && fi < p->func_count; fi++){
+    if(fi >= 0 && p->funcs[fi].code_start < 0) continue;   // quitada
+    int d = code_depth(p, fi, &w);
+    if(fi < 0) ok = d >= 0;
+    else {
+      p->funcs[fi].max_depth = d;
+      ok = d >= 0 && p->funcs[fi].local_count + 1 + d <= MAX_STACK;
+    }
+  }
+  free(w.depth);
+  free(w.owner);
+  free(w.work);
+  return ok;
+}
+
+// ---------- EJECUCIÓN ----------
+// Los enteros viven ya extendidos en signo en Value.i32: leerlos es directo.
+static inline int32_t value_to_i32(Value v) {
+  return v.i32;
+}
+
+// Resultado aritmético con el tipo `t` del operando izquierdo; un bool
+// promociona a int32 como en C, así (a<b)+1 vale lo mismo plegado o no.
+static inline Value i32_to_value(int32_t i, uint8_t t) {
     Value v;
     v.type = t;
     switch(t) {
-        case T_I8:   v.i8 = (int8_t)i; break;
-        case T_I16:  v.i16 = (int16_t)i; break;
-        case T_I32:  v.i32 = i; break;
-        case T_BOOL: v.boolean = i ? 1 : 0; break;
-        default: v.i32 = i; break; // fallback
+        case T_I8:   v.i32 = (int8_t)i; break;
+        case T_I16:  v.i32 = (int16_t)i; break;
+        case T_BOOL: v.i32 = i; v.type = T_I32; break;
+        default:     v.i32 = i; break;
     }
     return v;
 }
 
-static int native_count = sizeof(native_table)/sizeof(NativeEntry);
-  
-void register_native(){ 
- for (int i = 0; i < native_count; i++) {
-	 if(vm.sym.count >= MAX_SYM) return;
-    Symbol *s = &vm.sym.table[vm.sym.count++];	
-    strncpy(s->name, native_table[i].name, 31);
-	s->name[31] = '\0';
-    s->type = T_VOID;  // Assume void return for now
-    s->kind = SYM_NATIVE;
-    s->index = i;
-    s->scope_level = 0;
-  }
-}
-
-void minic_run(const char *src){
-  memset(&vm,0,sizeof(vm));
-  register_native();
-  lx.src = src; lx.pos=0;
-  next_tok();
+// ---------- DESPACHO ----------
+// Con GCC/Clang el bucle usa computed goto (código "threaded"): cada handler
+// salta directamente al siguiente a través de la tabla `dispatch`, sin el
+// compare de límites del while ni el salto común del switch. Definir
+// MINIC_SWITCH_DISPATCH fuerza el switch clásico (compiladores sin la
+// extensión o para comparar rendimiento).
+#if defined(__GNUC__) && !defined(MINIC_SWITCH_DISPATCH)
+#define MINIC_THREADED 1
+#else
+#define MINIC_THREADED 0
+#endif
 
-  vm.fp = 0;  // Root frame
-  vm.frames[0].local_count = 0;
-  vm.frames[0].param_count = 0;
-  
-  while(lx.tok!=TK_END) stmt();
+#if MINIC_THREADED
+#define VM_LABEL_ADDR(op, len) &&L_##op,
+#define VM_LOOP           goto *dispatch[*pc++];
+#define VM_CASE(op)       L_##op:
+#define VM_NEXT           do { VM_PROF(prof_step(prof, pc, func)); goto *dispatch[*pc++]; } while (0)
+#define VM_DEFAULT
+#else
+#define VM_LOOP           for(;;) switch((OpCode)*pc++)
+#define VM_CASE(op)       case op:
+#define VM_NEXT           { VM_PROF(prof_step(prof, pc, func)); break; }
+#define VM_DEFAULT        default: vm_fault("unknown opcode"); goto halt;
+#endif
 
-  // Find and call 'main' if exists
-  int main_idx = sym_lookup("main");
-  if (main_idx >= 0 && vm.sym.table[main_idx].kind == SYM_FUNC) {
-    emit(OP_CALL);
-    emit_i(vm.sym.table[main_idx].index);
+// Ganchos del perfilador: sin MINIC_PROFILE no generan nada
+#if MINIC_PROFILE
+#define VM_PROF(call)     do { if (prof) call; } while (0)
+
+#if defined(ARDUINO_ARCH_RP2040)
+// SysTick de cada núcleo, a la frecuencia de la CPU: 24 bits hacia abajo
+#include "hardware/structs/systick.h"
+#define PROF_NOW()        (0xFFFFFFu - systick_hw->cvr)
+#define PROF_MASK         0xFFFFFFu
+static inline void prof_clock_init(void){
+  if (!(systick_hw->csr & 1) || systick_hw->rvr != 0xFFFFFF) {
+    systick_hw->rvr = 0xFFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 5;   // activo, reloj del procesador
   }
+}
+#else
+#include <time.h>
+static inline uint32_t prof_ns(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint32_t)(t.tv_sec * 1000000000ull + t.tv_nsec);
+}
+#define PROF_NOW()        prof_ns()
+#define PROF_MASK         0xFFFFFFFFu
+static inline void prof_clock_init(void){}
+#endif
 
-  vm.ip = 0;
-  vm.sp = 0;
-  vm.fp = -1;
+// Temporizador del muestreo (uno para todo el sistema): solo marca
+// pr->sample; la VM lo atiende en su siguiente dispatch
+static MinicProfile *sampler_prof;
+#if defined(ARDUINO_ARCH_RP2040)
+static repeating_timer_t sampler_timer;
 
-  while(vm.ip < vm.code_size){
-    OpCode op = (OpCode)vm.code[vm.ip++];
-    switch(op){
-      case OP_NOP: break;
-      case OP_PUSH_CONST:{
-        int32_t val = (int32_t)vm.code[vm.ip++];
-        Value *dest = &vm.stack[vm.sp++];
-        if (val & (1 << 30)) {  // String tag
-          int sid = val & ~(1 << 30);
-          dest->type = T_STRING;
-          strncpy(dest->str, vm.string_pool[sid], MAX_STRING - 1);
-        } else {
-          dest->type = T_I32;
-          dest->i32 = val;
-        }
-        break;
-      }
-	  case OP_PUSH_VAR: {
-        int idx = (int32_t)vm.code[vm.ip++];
-        Value *src;
-        if (idx & 0x80000000) {  // Local
-          idx &= ~0x80000000;
-          src = &vm.frames[vm.fp].locals[idx];
-        } else {  // Global
-          src = &vm.globals[idx];
-        }
-        vm.stack[vm.sp++] = *src;
-        break;
-      }
-      case OP_STORE_VAR: {
-        int idx = (int32_t)vm.code[vm.ip++];
-        Value *dest;
-        if (idx & 0x80000000) {  // Local
-          idx &= ~0x80000000;
-          dest = &vm.frames[vm.fp].locals[idx];
-        } else {  // Global
-          dest = &vm.globals[idx];
-        }
-        *dest = vm.stack[--vm.sp];
-        break;
-      }
-      case OP_ADD: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res = i32_to_value(value_to_i32(a) + value_to_i32(b), a.type);
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_SUB: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res = i32_to_value(value_to_i32(a) - value_to_i32(b), a.type);
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_MUL: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res = i32_to_value(value_to_i32(a) * value_to_i32(b), a.type);
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_DIV: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res = i32_to_value(value_to_i32(a) / value_to_i32(b), a.type);
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_MOD: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res = i32_to_value(value_to_i32(a) % value_to_i32(b), a.type);
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-	  case OP_EQ: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res;
-        res.type = T_BOOL;
-        res.boolean = (value_to_i32(a) == value_to_i32(b));
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_NE: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res;
-        res.type = T_BOOL;
-        res.boolean = (value_to_i32(a) != value_to_i32(b));
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-	  case OP_LT: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res;
-        res.type = T_BOOL;
-        res.boolean = (value_to_i32(a) < value_to_i32(b));
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_GT: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res;
-        res.type = T_BOOL;
-        res.boolean = (value_to_i32(a) > value_to_i32(b));
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_LE: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res;
-        res.type = T_BOOL;
-        res.boolean = (value_to_i32(a) <= value_to_i32(b));
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_GE: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res;
-        res.type = T_BOOL;
-        res.boolean = (value_to_i32(a) >= value_to_i32(b));
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_NOT: {
-        Value a = vm.stack[--vm.sp];
-        Value res = i32_to_value(!value_to_i32(a), a.type);
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_NEG: {
-        Value a = vm.stack[--vm.sp];
-        Value res = i32_to_value(-value_to_i32(a), a.type);
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_AND: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res = i32_to_value(value_to_i32(a) && value_to_i32(b), T_BOOL);
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_OR: {
-        Value b = vm.stack[--vm.sp];
-        Value a = vm.stack[--vm.sp];
-        Value res = i32_to_value(value_to_i32(a) || value_to_i32(b), T_BOOL);
-        vm.stack[vm.sp++] = res;
-        break;
-      }
-      case OP_JMP: vm.ip = (int)vm.code[vm.ip]; break;
-      case OP_JMP_FALSE: {
-        int tgt = (int)vm.code[vm.ip++];
-        Value cond = vm.stack[--vm.sp];
-        if (!value_to_i32(cond)) vm.ip = tgt;
-        break;
-      }
-      case OP_JMP_TRUE: {
-        int tgt = (int)vm.code[vm.ip++];
-        Value cond = vm.stack[--vm.sp];
-        if (value_to_i32(cond)) vm.ip = tgt;
-        break;
-      }
-      case OP_CALL: {
-        int func_idx = (int)vm.code[vm.ip++];
-        Function *f = &vm.funcs[func_idx];
-        vm.fp++;
-        vm.frames[vm.fp].ret_ip = vm.ip;
-        vm.frames[vm.fp].ret_sp = vm.sp;  // Pop params after return
-		//vm.sp -= f->param_count;
-        vm.frames[vm.fp].func_index = func_idx;
-        // Move params to locals (params are first locals)
-        for (int i = 0; i < f->param_count; i++) {
-          vm.frames[vm.fp].locals[i] = vm.stack[vm.sp - f->param_count + i];
-        }
-        vm.sp -= f->param_count;
-        vm.frames[vm.fp].local_count = f->param_count;  // Locals start after params
-        vm.ip = f->code_start;
-        break;
+static bool sampler_cb(repeating_timer_t *t){
+  ((MinicProfile *)t->user_data)->sample.store(1, std::memory_order_relaxed);
+  return true;
+}
+
+static int sampler_start(MinicProfile *pr){
+  if(sampler_prof) return -1;
+  if(!add_repeating_timer_us(-(int64_t)pr->period_us, sampler_cb, pr, &sampler_timer)) return -1;
+  sampler_prof = pr;
+  return 0;
+}
+
+static void sampler_stop(MinicProfile *pr){
+  if(sampler_prof != pr) return;
+  cancel_repeating_timer(&sampler_timer);
+  sampler_prof = NULL;
+}
+#else
+#include <thread>
+#include <chrono>
+#include <atomic>
+static std::thread sampler_thread;
+static std::atomic<bool> sampler_run;
+
+static int sampler_start(MinicProfile *pr){
+  if(sampler_prof) return -1;
+  sampler_prof = pr;
+  sampler_run = true;
+  sampler_thread = std::thread([pr]{
+    while(sampler_run){
+      std::this_thread::sleep_for(std::chrono::microseconds(pr->period_us));
+      pr->sample.store(1, std::memory_order_relaxed);
+    }
+  });
+  return 0;
+}
+
+static void sampler_stop(MinicProfile *pr){
+  if(sampler_prof != pr) return;
+  sampler_run = false;
+  sampler_thread.join();
+  sampler_prof = NULL;
+}
+#endif
+
+// Cierra el tramo en curso: su tiempo va al opcode y a la función que
+// lo ejecutaban
+static inline void prof_flush(MinicProfile *pr){
+  uint32_t now = PROF_NOW();
+  uint32_t d = (now - pr->last) & PROF_MASK;
+  pr->last = now;
+  pr->clock += d;
+  pr->op_cycles[pr->op] += d;
+  pr->fn[pr->fn_cur].excl += d;
+}
+
+static inline void prof_begin(MinicProfile *pr, int op, int func){
+  pr->op = (uint8_t)op;
+  pr->op_count[op]++;
+  pr->fn_cur = func == NO_FUNC ? pr->nfn - 1 : func;
+}
+
+static inline void prof_tick(MinicProfile *pr, int op, int func){
+  prof_flush(pr);
+  prof_begin(pr, op, func);
+}
+
+// En CALL y RET el reloj se cierra en el momento del cambio de función,
+// así el inclusivo de `fi` y su exclusivo miden el mismo intervalo
+static inline void prof_push(MinicProfile *pr, int fi){
+  ProfFunc *f = &pr->fn[fi];
+  pr->fn_cur = fi;
+  f->calls++;
+  f->active++;
+  if (pr->depth < PROF_DEPTH) pr->enter[pr->depth] = pr->clock;
+  pr->depth++;
+}
+
+static inline void prof_call(MinicProfile *pr, int fi){
+  if (pr->period_us) return;
+  prof_flush(pr);
+  prof_push(pr, fi);
+}
+
+static inline void prof_ret(MinicProfile *pr, int fi, int caller){
+  if (pr->period_us) return;
+  ProfFunc *f = &pr->fn[fi];
+  prof_flush(pr);
+  pr->fn_cur = caller == NO_FUNC ? pr->nfn - 1 : caller;
+  pr->depth--;
+  if (--f->active == 0 && pr->depth >= 0 && pr->depth < PROF_DEPTH)
+    f->incl += pr->clock - pr->enter[pr->depth];
+}
+
+// Muestreo: el temporizador marcó `sample`; la muestra va a la línea
+// de la próxima instrucción
+static void prof_sample(MinicProfile *pr, const uint8_t *pc){
+  pr->sample.store(0, std::memory_order_relaxed);
+  pr->samples++;
+  int e = line_entry(pr->prog, (int)(pc - pr->prog->code));
+  if (e >= 0) pr->hits[e]++;
+}
+
+// Gancho de cada dispatch. El modo exacto ya paga un reloj por opcode;
+// fuera de línea deja al muestreo solo una comparación.
+static __attribute__((noinline)) void prof_exact(MinicProfile *pr, int op, int func){
+  prof_tick(pr, op, func);
+}
+
+static inline void prof_step(MinicProfile *pr, const uint8_t *pc, int func){
+  if (pr->period_us) {
+    if (pr->sample.load(std::memory_order_relaxed)) prof_sample(pr, pc);
+  } else {
+    prof_exact(pr, *pc, func);
+  }
+}
+#else
+#define VM_PROF(call)     do {} while (0)
+#endif
+
+// a = a op b, resultado con el tipo del operando izquierdo
+#define VM_ARITH(OP) { \
+    Value b = *--sp; Value *a = sp - 1; \
+    *a = i32_to_value(a->i32 OP b.i32, a->type); \
+  }
+// versiones tipadas: el compilador ya garantiza que ambos son enteros
+#define VM_ARITH_I32(OP) { \
+    Value b = *--sp; Value *a = sp - 1; \
+    a->i32 = a->i32 OP b.i32; a->type = T_I32; \
+  }
+// a / b y a % b con el tipo T: ÷0 es un fallo y a / -1 se hace como -a
+// con desborde (INT32_MIN / -1 = INT32_MIN, INT32_MIN % -1 = 0), que en C
+// no está definido y en el host mata el proceso
+#define VM_DIV(OP, T) { \
+    Value b = *--sp; Value *a = sp - 1; \
+    if (b.i32 == 0) { vm_fault("division by zero"); goto halt; } \
+    int32_t r = b.i32 == -1 ? (int32_t)(0u - (uint32_t)a->i32) OP 1 : a->i32 OP b.i32; \
+    *a = i32_to_value(r, T); \
+  }
+#define VM_ARITH_NARROW(OP, CT, T) { \
+    Value b = *--sp; Value *a = sp - 1; \
+    a->i32 = (CT)(a->i32 OP b.i32); a->type = T; \
+  }
+// a = (a op b) como bool
+#define VM_CMP(OP) { \
+    Value b = *--sp; Value *a = sp - 1; \
+    a->i32 = (a->i32 OP b.i32); a->type = T_BOOL; \
+  }
+// pop b, a; salta si !(a op b)
+#define VM_CMP_JMP_FALSE(OP) { \
+    uint16_t tgt = RD16(pc); pc += 2; sp -= 2; \
+    if (!(sp[0].i32 OP sp[1].i32)) pc = code + tgt; \
+  }
+// slot de superinstrucción: bit 7 = local del frame actual
+#define VM_VAR(slot) ((slot) & SLOT_LOCAL ? &locals[(slot) & ~SLOT_LOCAL] : &self->globals[slot])
+
+static_assert(MAX_CODE <= 0xFFFF && MAX_STACK <= 0xFFFF, "ret_ip y bp van en 16 bits");
+
+static inline void call_record(Value *rec, uint32_t ret_ip, uint32_t bp, int func){
+  rec->i32 = (int32_t)(ret_ip | bp << 16);
+  rec->type = (uint8_t)func;
+}
+
+// Error en ejecución: se informa y vm_exec() abandona la llamada
+static void vm_fault(const char *msg){
+  MiniCVM *self = minic_vm();
+  if(self->core1){   // la consola es del núcleo 0
+    core1_puts("[runtime] ");
+    core1_puts(msg);
+    core1_puts("\n");
+  } else {
+    printf("[runtime] %s\n", msg);
+  }
+  self->fault = 1;
+}
+
+// Ejecuta el código de self->prog desde self->ip hasta OP_HALT o hasta
+// gastar `ticks` (uno por salto y por llamada: todo bucle y toda recursión
+// pasan por ahí) o que una nativa pida yield(). ip, sp y la ventana actual
+// se llevan en locales (registros) y se vuelcan a self al salir, así que
+// un turno cedido sigue con otra llamada a vm_exec(). Mientras tanto self
+// es la instancia actual (minic_vm()) para las nativas; una nativa puede a su
+// vez ejecutar otra instancia.
+static int vm_exec(MiniCVM *self, int32_t ticks){
+#if MINIC_THREADED
+  static const void *const dispatch[OP_COUNT] = { MINIC_OPCODES(VM_LABEL_ADDR) };
+#endif
+  MiniCVM *caller = minic_set_vm(self);
+  const uint8_t *code = self->prog->code;
+  const Function *funcs = self->prog->funcs;
+  const uint8_t *pc = code + self->ip;
+  Value *sp = self->stack + self->sp;
+  Value *locals = self->stack + self->bp;
+  int func = self->func;
+  int status = VM_HALTED;
+#if MINIC_PROFILE
+  MinicProfile *prof = self->prof;
+  if (prof && prof->period_us) {
+    prof->sample.store(0, std::memory_order_relaxed);   // marcas de mientras no corría: no cuentan
+  } else if (prof) {
+    prof_clock_init();
+    prof->last = PROF_NOW();   // lo de fuera de vm_exec() no cuenta
+    prof_begin(prof, *pc, func);
+  }
+#endif
+
+  VM_LOOP {
+    VM_CASE(OP_NOP) VM_NEXT;
+    VM_CASE(OP_HALT) goto halt;
+    VM_CASE(OP_POP) sp--; VM_NEXT;
+    VM_CASE(OP_DUP) *sp = sp[-1]; sp++; VM_NEXT;
+    VM_CASE(OP_PUSH_I8) {
+      sp->type = T_I32;
+      sp->i32 = (int8_t)*pc++;
+      sp++;
+      VM_NEXT;
+    }
+    VM_CASE(OP_PUSH_I16) {
+      sp->type = T_I32;
+      sp->i32 = (int16_t)RD16(pc);
+      pc += 2;
+      sp++;
+      VM_NEXT;
+    }
+    VM_CASE(OP_PUSH_CONST) {
+      sp->type = T_I32;
+      sp->i32 = (int32_t)RD32(pc);
+      pc += 4;
+      sp++;
+      VM_NEXT;
+    }
+    VM_CASE(OP_PUSH_STR) {   // el handle es el índice del pool
+      sp->type = T_STRING;
+      sp->i32 = *pc++;
+      sp++;
+      VM_NEXT;
+    }
+    VM_CASE(OP_PUSH_GLOBAL) *sp++ = self->globals[*pc++]; VM_NEXT;
+    VM_CASE(OP_PUSH_LOCAL) *sp++ = locals[*pc++]; VM_NEXT;
+    VM_CASE(OP_STORE_GLOBAL) self->globals[*pc++] = *--sp; VM_NEXT;
+    VM_CASE(OP_STORE_LOCAL) locals[*pc++] = *--sp; VM_NEXT;
+    VM_CASE(OP_ADD) VM_ARITH(+) VM_NEXT;
+    VM_CASE(OP_SUB) VM_ARITH(-) VM_NEXT;
+    VM_CASE(OP_MUL) VM_ARITH(*) VM_NEXT;
+    VM_CASE(OP_DIV) VM_DIV(/, a->type) VM_NEXT;
+    VM_CASE(OP_MOD) VM_DIV(%, a->type) VM_NEXT;
+    VM_CASE(OP_XOR) VM_ARITH(^) VM_NEXT;
+    VM_CASE(OP_SHL) VM_ARITH(<<) VM_NEXT;
+    VM_CASE(OP_SHR) VM_ARITH(>>) VM_NEXT;
+    VM_CASE(OP_BAND) VM_ARITH(&) VM_NEXT;
+    VM_CASE(OP_BOR) VM_ARITH(|) VM_NEXT;
+    VM_CASE(OP_EQ) VM_CMP(==) VM_NEXT;
+    VM_CASE(OP_NE) VM_CMP(!=) VM_NEXT;
+    VM_CASE(OP_LT) VM_CMP(<) VM_NEXT;
+    VM_CASE(OP_GT) VM_CMP(>) VM_NEXT;
+    VM_CASE(OP_LE) VM_CMP(<=) VM_NEXT;
+    VM_CASE(OP_GE) VM_CMP(>=) VM_NEXT;
+    VM_CASE(OP_ADD_I32) VM_ARITH_I32(+) VM_NEXT;
+    VM_CASE(OP_SUB_I32) VM_ARITH_I32(-) VM_NEXT;
+    VM_CASE(OP_MUL_I32) VM_ARITH_I32(*) VM_NEXT;
+    VM_CASE(OP_DIV_I32) VM_DIV(/, T_I32) VM_NEXT;
+    VM_CASE(OP_MOD_I32) VM_DIV(%, T_I32) VM_NEXT;
+    VM_CASE(OP_BAND_I32) VM_ARITH_I32(&) VM_NEXT;
+    VM_CASE(OP_BOR_I32) VM_ARITH_I32(|) VM_NEXT;
+    VM_CASE(OP_XOR_I32) VM_ARITH_I32(^) VM_NEXT;
+    VM_CASE(OP_SHL_I32) VM_ARITH_I32(<<) VM_NEXT;
+    VM_CASE(OP_SHR_I32) VM_ARITH_I32(>>) VM_NEXT;
+    VM_CASE(OP_ADD_I8) VM_ARITH_NARROW(+, int8_t, T_I8) VM_NEXT;
+    VM_CASE(OP_SUB_I8) VM_ARITH_NARROW(-, int8_t, T_I8) VM_NEXT;
+    VM_CASE(OP_ADD_I16) VM_ARITH_NARROW(+, int16_t, T_I16) VM_NEXT;
+    VM_CASE(OP_SUB_I16) VM_ARITH_NARROW(-, int16_t, T_I16) VM_NEXT;
+    VM_CASE(OP_CAST_I8) sp[-1].i32 = (int8_t)sp[-1].i32; sp[-1].type = T_I8; VM_NEXT;
+    VM_CASE(OP_CAST_I16) sp[-1].i32 = (int16_t)sp[-1].i32; sp[-1].type = T_I16; VM_NEXT;
+    VM_CASE(OP_CAST_I32) sp[-1].type = T_I32; VM_NEXT;
+    VM_CASE(OP_CAST_BOOL) sp[-1].i32 = sp[-1].i32 != 0; sp[-1].type = T_BOOL; VM_NEXT;
+    VM_CASE(OP_AND) VM_CMP(&&) VM_NEXT;
+    VM_CASE(OP_OR) VM_CMP(||) VM_NEXT;
+    VM_CASE(OP_NOT) {
+      Value *a = sp - 1;
+      *a = i32_to_value(!a->i32, a->type);
+      VM_NEXT;
+    }
+    VM_CASE(OP_NEG) {
+      Value *a = sp - 1;
+      *a = i32_to_value(-a->i32, a->type);
+      VM_NEXT;
+    }
+    VM_CASE(OP_JMP) {
+      pc = code + RD16(pc);
+      if (--ticks <= 0) goto preempt;
+      VM_NEXT;
+    }
+    VM_CASE(OP_JMP_FALSE) {
+      uint16_t tgt = RD16(pc);
+      pc += 2;
+      if (!(--sp)->i32) pc = code + tgt;
+      VM_NEXT;
+    }
+    VM_CASE(OP_JMP_TRUE) {
+      uint16_t tgt = RD16(pc);
+      pc += 2;
+      if ((--sp)->i32) pc = code + tgt;
+      VM_NEXT;
+    }
+    VM_CASE(OP_CALL) {
+      // los argumentos ya apilados pasan a ser los primeros locals
+      int callee = *pc++;
+      const Function *f = &funcs[callee];
+      Value *base = sp - f->param_count;
+      Value *rec = base + f->local_count;
+      if (rec + 1 + f->max_depth > self->stack + MAX_STACK) { vm_fault("call stack overflow"); goto halt; }
+      for (sp = base + f->param_count; sp < rec; sp++) { sp->i32 = 0; sp->type = T_VOID; }
+      call_record(rec, (uint32_t)(pc - code), (uint32_t)(locals - self->stack), func);
+      VM_PROF(prof_call(prof, callee));
+      sp = rec + 1;
+      locals = base;
+      func = callee;
+      pc = code + f->code_start;
+      if (--ticks <= 0) goto preempt;
+      VM_NEXT;
+    }
+    VM_CASE(OP_TAIL_CALL) {
+      // como OP_CALL, pero la ventana del llamado empieza donde la actual
+      // y hereda su registro de retorno: recursión de cola sin crecer
+      int callee = *pc++;
+      const Function *f = &funcs[callee];
+      Value link = locals[funcs[func].local_count];
+      Value *rec = locals + f->local_count;
+      if (rec + 1 + f->max_depth > self->stack + MAX_STACK) { vm_fault("call stack overflow"); goto halt; }
+      memmove(locals, sp - f->param_count, f->param_count * sizeof(Value));
+      for (sp = locals + f->param_count; sp < rec; sp++) { sp->i32 = 0; sp->type = T_VOID; }
+      *rec = link;
+      VM_PROF(prof_ret(prof, func, link.type));   // para el perfil: return + call
+      VM_PROF(prof_call(prof, callee));
+      sp = rec + 1;
+      func = callee;
+      pc = code + f->code_start;
+      if (--ticks <= 0) goto preempt;
+      VM_NEXT;
+    }
+    VM_CASE(OP_RET) {
+      Value ret_val = *--sp;  // siempre hay valor (return implícito = 0)
+      const Value *rec = locals + funcs[func].local_count;
+      uint32_t link = (uint32_t)rec->i32;
+      VM_PROF(prof_ret(prof, func, rec->type));
+      func = rec->type;
+      sp = locals;            // descarta params, locals y operandos
+      *sp++ = ret_val;
+      locals = self->stack + (link >> 16);
+      pc = code + (link & 0xFFFF);
+      VM_NEXT;
+    }
+    VM_CASE(OP_NATIVE_CALL) {
+      const NativeEntry *ne = &native_table[*pc++];
+      int argc = *pc++;
+      int32_t args[MAX_PARAM];
+      Value *base = sp - argc;
+      for (int i = 0; i < argc; i++) {
+        // strings: se pasa el handle etiquetado, sin buscar ni copiar
+        args[i] = base[i].type == T_STRING ? (base[i].i32 | STR_TAG) : base[i].i32;
+        // un array de tipo no conocido al compilar (T_ANY) se mira aquí
+        if (ne->arr_args >> i & 1 && base[i].type != T_ARRAY) { vm_fault("not an array"); goto halt; }
       }
-      case OP_RET: {
-        Value ret_val = vm.stack[--vm.sp];  // Assume return value on stack
-        vm.sp = vm.frames[vm.fp].ret_sp;
-        vm.ip = vm.frames[vm.fp].ret_ip;
-        vm.stack[vm.sp++] = ret_val;  // Push return value
-        vm.fp--;
-        break;
+      self->sp = (int)(sp - self->stack);   // args incluidos: raíces si recolecta
+      base->i32 = ne->core0 && self->core1 ? core1_native((int)(ne - native_table), args, argc)
+                                           : ne->fn(args, argc);
+      base->type = ne->str_ret ? T_STRING : T_I32;
+      sp = base + 1;
+      if (self->fault) goto halt;      // la nativa llamó a vm_fault()
+      if (self->yield) goto suspend;   // yield() / sleep()
+      VM_NEXT;
+    }
+    // --- superinstrucciones ---
+    VM_CASE(OP_INC_VAR) {
+      Value *v = VM_VAR(pc[0]);
+      *v = i32_to_value(v->i32 + (int8_t)pc[1], v->type);
+      pc += 2;
+      VM_NEXT;
+    }
+    VM_CASE(OP_INC_VAR_I32) {
+      VM_VAR(pc[0])->i32 += (int8_t)pc[1];
+      pc += 2;
+      VM_NEXT;
+    }
+    VM_CASE(OP_ADD_CONST_I32) sp[-1].i32 += (int8_t)*pc++; sp[-1].type = T_I32; VM_NEXT;
+    VM_CASE(OP_ADD_CONST) {
+      Value *a = sp - 1;
+      *a = i32_to_value(a->i32 + (int8_t)*pc++, a->type);
+      VM_NEXT;
+    }
+    VM_CASE(OP_PUSH_VAR_PUSH_VAR) {
+      sp[0] = *VM_VAR(pc[0]);
+      sp[1] = *VM_VAR(pc[1]);
+      sp += 2;
+      pc += 2;
+      VM_NEXT;
+    }
+    VM_CASE(OP_EQ_JMP_FALSE) VM_CMP_JMP_FALSE(==) VM_NEXT;
+    VM_CASE(OP_NE_JMP_FALSE) VM_CMP_JMP_FALSE(!=) VM_NEXT;
+    VM_CASE(OP_LT_JMP_FALSE) VM_CMP_JMP_FALSE(<) VM_NEXT;
+    VM_CASE(OP_GT_JMP_FALSE) VM_CMP_JMP_FALSE(>) VM_NEXT;
+    VM_CASE(OP_LE_JMP_FALSE) VM_CMP_JMP_FALSE(<=) VM_NEXT;
+    VM_CASE(OP_GE_JMP_FALSE) VM_CMP_JMP_FALSE(>=) VM_NEXT;
+    VM_CASE(OP_FOR_LT_CONST) {
+      Value *v = VM_VAR(pc[2]);
+      v->i32 += (int8_t)pc[3];
+      if (v->i32 >= (int32_t)RD32(pc + 4)) { pc += 8; VM_NEXT; }
+      pc = code + RD16(pc);   // salto atrás: cuenta como OP_JMP
+      if (--ticks <= 0) goto preempt;
+      VM_NEXT;
+    }
+    VM_CASE(OP_JMP_TABLE) {
+      uint32_t i = (uint32_t)(--sp)->i32 - RD32(pc);
+      uint16_t n = RD16(pc + 4);
+      if (i > n) i = n;   // fuera del rango: la última entrada (default)
+      pc = code + RD16(pc + 6 + 3 * i + 1);
+      VM_NEXT;
+    }
+    VM_CASE(OP_JMP_SEARCH) {
+      int32_t v = (--sp)->i32;
+      int n = RD16(pc), lo = 0, hi = n;
+      const uint8_t *t = pc + 2;   // entradas de 8 bytes: PUSH_CONST k; JMP
+      while (lo < hi) {            // primera con k >= v
+        int mid = (lo + hi) >> 1;
+        if ((int32_t)RD32(t + 8 * mid + 1) < v) lo = mid + 1;
+        else hi = mid;
       }
-      case OP_NATIVE_CALL: {
-        int native_idx = (int)vm.code[vm.ip++];
-        int argc = (int)vm.code[vm.ip++];
-        NativeEntry *ne = &native_table[native_idx];
-        int32_t args[MAX_PARAM];
-        for (int i = argc - 1; i >= 0; i--) {
-          Value arg = vm.stack[--vm.sp];
-          if (arg.type == T_STRING) {
-            // For strings, pass tagged SID
-            for (int j = 0; j < vm.string_count; j++) {
-              if (!strcmp(vm.string_pool[j], arg.str)) {
-                args[i] = j | (1 << 30);
-                break;
-              }
-            }
-          } else {
-            args[i] = value_to_i32(arg);
-          }
-        }
-        int32_t ret = ne->fn(args, argc);
-        vm.stack[vm.sp++] = i32_to_value(ret, T_I32);
-        break;
+      const uint8_t *e = lo < n && (int32_t)RD32(t + 8 * lo + 1) == v ? t + 8 * lo + 5 : t + 8 * n;
+      pc = code + RD16(e + 1);
+      VM_NEXT;
+    }
+    VM_CASE(OP_FOR_LT_VAR) {
+      Value *v = VM_VAR(pc[2]);
+      v->i32 += (int8_t)pc[3];
+      if (v->i32 >= VM_VAR(pc[4])->i32) { pc += 5; VM_NEXT; }
+      pc = code + RD16(pc);
+      if (--ticks <= 0) goto preempt;
+      VM_NEXT;
+    }
+    VM_CASE(OP_ARR_NEW) {
+      int n = sp[-1].i32;
+      if (n < 0 || n > MAX_ARRAY_LEN) { vm_fault("bad array length"); goto halt; }
+      self->sp = (int)(sp - self->stack);   // raíces si recolecta
+      int h = arr_new(*pc++, n);
+      if (h < 0) { vm_fault("out of array memory"); goto halt; }
+      sp[-1].i32 = h;
+      sp[-1].type = T_ARRAY;
+      VM_NEXT;
+    }
+    VM_CASE(OP_ARR_LOAD) {   // [arr, idx] -> [valor int32]
+      uint32_t idx = (uint32_t)(--sp)->i32;
+      Value *a = sp - 1;
+      if (a->type != T_ARRAY || (uint32_t)a->i32 >= MAX_ARRAYS || !self->arrays[a->i32].data) { vm_fault("not an array"); goto halt; }
+      const VmArray *arr = &self->arrays[a->i32];
+      if (idx >= arr->length) { vm_fault("index out of bounds"); goto halt; }
+      a->i32 = arr_get(arr, idx);
+      a->type = T_I32;
+      VM_NEXT;
+    }
+    VM_CASE(OP_ARR_STORE) {   // [arr, idx, valor] -> []
+      sp -= 3;
+      uint32_t idx = (uint32_t)sp[1].i32;
+      if (sp[0].type != T_ARRAY || (uint32_t)sp[0].i32 >= MAX_ARRAYS || !self->arrays[sp[0].i32].data) { vm_fault("not an array"); goto halt; }
+      VmArray *arr = &self->arrays[sp[0].i32];
+      if (idx >= arr->length) { vm_fault("index out of bounds"); goto halt; }
+      arr_set(arr, idx, sp[2].i32);
+      VM_NEXT;
+    }
+    VM_CASE(OP_DUP2) sp[0] = sp[-2]; sp[1] = sp[-1]; sp += 2; VM_NEXT;
+    VM_DEFAULT
+  }
+
+preempt:
+  status = VM_PREEMPTED;
+  goto halt;
+suspend:
+  self->yield = 0;
+  status = VM_YIELDED;
+halt:
+  VM_PROF(if (!prof->period_us) prof_flush(prof));
+  self->ip = (int)(pc - code);
+  self->sp = (int)(sp - self->stack);
+  self->bp = (int)(locals - self->stack);
+  self->func = func;
+  minic_set_vm(caller);
+  return self->fault ? VM_FAULTED : status;
+}
+
+// Hasta OP_HALT o un error, reanudando los turnos que se cedan
+static int vm_finish(MiniCVM *self){
+  int st;
+  while ((st = vm_exec(self, VM_UNLIMITED)) == VM_YIELDED || st == VM_PREEMPTED) {}
+  return st;
+}
+
+// ---------- PROGRAMAS E INSTANCIAS ----------
+void minic_program_free(MinicProgram *p){
+  if(!p) return;
+  arena_release(&p->arena);
+  free(p);
+}
+
+// Compila el fuente ya abierto en lx; NULL (con el error ya mostrado) si
+// falla. El estado del compilador solo vive durante la llamada.
+static MinicProgram *compile_program(void){
+  if(setjmp(compile_fail)){   // syntax(): se descarta lo que se llevaba
+    minic_program_free(prog);
+    free(cc);
+    prog = NULL;
+    cc = NULL;
+    return NULL;
+  }
+  prog = (MinicProgram *)calloc(1, sizeof(MinicProgram));
+  cc = (Compiler *)calloc(1, sizeof(Compiler));   // frame raíz a cero
+  if(!prog || !cc) syntax("out of memory");
+  cur_loop = NULL;
+  pend_id[0] = '\0';
+  next_tok();
+
+  while(lx.tok!=TK_END) stmt();
+  compile_called();
+
+  emit(OP_HALT);   // fin de la inicialización; minic_call() vuelve aquí
+  if (minic_lazy) strip_dead_funcs();
+  if (minic_opt) peephole();
+  if (!stack_depths(prog)) syntax("expression stack too deep");
+
+  free(cc);
+  cc = NULL;
+  MinicProgram *p = prog;
+  prog = NULL;
+  return p;
+}
+
+MinicProgram *minic_compile(const char *src){
+  lx_open(src);
+  return compile_program();
+}
+
+// Compila leyendo el fuente por trozos desde `read`
+MinicProgram *minic_compile_stream(MinicReader read, void *ctx, MinicSeek seek){
+  lx_open_reader(read, ctx, seek);
+  return compile_program();
+}
+
+int minic_func(const MinicProgram *p, const char *name){
+  for(int i = 0; i < p->func_count; i++)
+    if(!strcmp(p->funcs[i].name, name) && p->funcs[i].code_start >= 0) return i;
+  return -1;
+}
+
+// Instancia de `p` lista para ejecutar el código de nivel superior
+static MiniCVM *vm_alloc(const MinicProgram *p){
+  MiniCVM *v = (MiniCVM *)calloc(1, sizeof(MiniCVM));
+  if(!v) return NULL;
+  v->prog = p;
+  v->func = NO_FUNC;
+  for(int i = 0; i < p->global_count; i++) v->globals[i].type = p->global_types[i];
+  return v;
+}
+
+// Nueva instancia de `p` con sus globals ya inicializados (el código de
+// nivel superior); NULL si falla
+MiniCVM *minic_vm_new(const MinicProgram *p){
+  MiniCVM *v = vm_alloc(p);
+  if(!v) return NULL;
+  if(vm_finish(v) == VM_FAULTED){
+    minic_vm_free(v);
+    return NULL;
+  }
+  v->sp = 0;
+  return v;
+}
+
+void minic_vm_free(MiniCVM *v){
+  if(!v) return;
+#if MINIC_PROFILE
+  if(v->prof) sampler_stop(v->prof);
+  free(v->prof);
+#endif
+  str_release(v);
+  arr_release(v);
+  free(v);
+}
+
+// Arma para la función `fi` la misma ventana que OP_CALL, sobre la pila
+// libre de la instancia, con retorno al OP_HALT final del programa; el
+// resultado queda en stack[base]. -1 si la función no existe o no cabe.
+static int vm_enter(MiniCVM *v, int fi, const int32_t *args, int argc){
+  const MinicProgram *p = v->prog;
+  if(fi < 0 || fi >= p->func_count || argc != p->funcs[fi].param_count) return -1;
+  if(p->funcs[fi].code_start < 0) return -1;   // quitada por minic_lazy
+  const Function *f = &p->funcs[fi];
+  int base = v->sp;
+  if(base + f->local_count + 1 + f->max_depth > MAX_STACK) return -1;
+
+  Value *w = v->stack + base;
+  for(int i = 0; i < f->local_count; i++){
+    if(i < argc) w[i] = i32_to_value(args[i], f->param_types[i]);
+    else { w[i].i32 = 0; w[i].type = T_VOID; }
+  }
+  call_record(&w[f->local_count], p->code_size - 1, v->bp, v->func);
+  v->sp = base + f->local_count + 1;
+  v->bp = base;
+  v->func = fi;
+  v->ip = f->code_start;
+#if MINIC_PROFILE
+  if(v->prof && !v->prof->period_us) prof_push(v->prof, fi);   // fuera de vm_exec(): sin reloj
+#endif
+  return 0;
+}
+
+// Llama a la función `fi` de la instancia con `argc` argumentos enteros y
+// deja su resultado en *ret; también se puede llamar desde una nativa que
+// la instancia esté ejecutando. 0 = ok, -1 si la función no existe o falló.
+int minic_call(MiniCVM *v, int fi, const int32_t *args, int argc, int32_t *ret){
+  int base = v->sp, bp = v->bp, func = v->func;
+  if(vm_enter(v, fi, args, argc) < 0) return -1;
+
+  int ok = vm_finish(v) != VM_FAULTED;
+  if(ok && ret) *ret = v->stack[base].i32;   // RET deja el resultado en la base
+  v->sp = base;
+  v->bp = bp;
+  v->func = func;
+  v->fault = 0;
+  return ok ? 0 : -1;
+}
+
+int minic_global(const MiniCVM *v, const char *name, int32_t *value){
+  const MinicProgram *p = v->prog;
+  for(int i = 0; i < p->global_count; i++)
+    if(p->global_names[i] && !strcmp(p->global_names[i], name)){
+      *value = v->globals[i].i32;
+      return 0;
+    }
+  return -1;
+}
+
+// Una ejecución completa: instancia nueva, main() si existe y fuera
+static int run_program(const MinicProgram *p){
+  MiniCVM *v = minic_vm_new(p);
+  if(!v) return -1;
+  int fi = minic_func(p, "main");
+  int r = fi >= 0 ? minic_call(v, fi, NULL, 0, NULL) : 0;
+  minic_vm_free(v);
+  return r;
+}
+
+int minic_run(const char *src){
+  MinicProgram *p = minic_compile(src);
+  if(!p) return -1;
+  int r = run_program(p);
+  minic_program_free(p);
+  return r;
+}
+
+#if MINIC_PROFILE
+// ---------- PERFIL ----------
+#define VM_OP_NAME(op, len) #op + 3,   // sin el "OP_"
+static const char *const op_names[OP_COUNT] = { MINIC_OPCODES(VM_OP_NAME) };
+
+// Empieza a perfilar la instancia desde su próxima ejecución; con
+// muestreo, las muestras por entrada de la tabla de líneas van tras fn[]
+int minic_profile_start(MiniCVM *v, uint32_t period_us){
+  const MinicProgram *p = v->prog;
+  if(v->prof){
+    sampler_stop(v->prof);
+    free(v->prof);
+    v->prof = NULL;
+  }
+  int nfn = p->func_count + 1;
+  int nhits = period_us ? p->line_count : 0;
+  MinicProfile *pr = (MinicProfile *)calloc(1, sizeof(MinicProfile) + nfn * sizeof(ProfFunc) +
+                                               nhits * sizeof(uint32_t));
+  if(!pr) return -1;
+  pr->prog = p;
+  pr->nfn = nfn;
+  pr->period_us = period_us;
+  pr->hits = (uint32_t *)(pr->fn + nfn);
+  if(period_us && sampler_start(pr) < 0){
+    free(pr);
+    return -1;
+  }
+  v->prof = pr;
+  return 0;
+}
+
+// Orden descendente de `n` claves (n pequeño: inserción)
+static void prof_sort(int *idx, const uint64_t *key, int n){
+  for(int i = 0; i < n; i++) idx[i] = i;
+  for(int i = 1; i < n; i++){
+    int k = idx[i], j = i;
+    for(; j > 0 && key[idx[j - 1]] < key[k]; j--) idx[j] = idx[j - 1];
+    idx[j] = k;
+  }
+}
+
+// Muestras por línea del fuente (varias entradas de la tabla pueden ser
+// de la misma línea); *nline = última línea + 1. NULL sin memoria.
+static uint32_t *prof_line_hits(const MinicProfile *pr, int *nline){
+  const MinicProgram *p = pr->prog;
+  int n = 1;
+  for(int i = 0; i < p->line_count; i++)
+    if(p->lines[i].line >= n) n = p->lines[i].line + 1;
+  uint32_t *hits = (uint32_t *)calloc(n, sizeof(uint32_t));
+  if(!hits) return NULL;
+  for(int i = 0; i < p->line_count; i++) hits[p->lines[i].line] += pr->hits[i];
+  *nline = n;
+  return hits;
+}
+
+#define PROF_TOP_LINES 10
+
+// Muestreo: las líneas con más muestras
+static void prof_report_lines(const MinicProfile *pr, void (*line)(const char *s, void *ctx), void *ctx){
+  char buf[64];
+  int n;
+  uint32_t *hits = prof_line_hits(pr, &n);
+  if(!hits) return;
+  uint32_t total = pr->samples ? pr->samples : 1;
+  snprintf(buf, sizeof(buf), "Muestras: %lu (cada %lu us)", (unsigned long)pr->samples,
+           (unsigned long)pr->period_us);
+  line(buf, ctx);
+  snprintf(buf, sizeof(buf), "%-8s %10s %6s", "LINEA", "MUESTRAS", "%");
+  line(buf, ctx);
+  for(int k = 0; k < PROF_TOP_LINES; k++){   // selección: n puede ser grande
+    int best = 0;
+    for(int i = 1; i < n; i++)
+      if(hits[i] > hits[best]) best = i;
+    if(!hits[best]) break;
+    char ln[8] = "-";   // línea 0: código sin línea (el OP_HALT final)
+    if(best) snprintf(ln, sizeof(ln), "%d", best);
+    snprintf(buf, sizeof(buf), "%-8s %10lu %5.1f%%", ln, (unsigned long)hits[best], 100.0 * hits[best] / total);
+    line(buf, ctx);
+    hits[best] = 0;
+  }
+  free(hits);
+}
+
+// Fuente anotado: cada línea con su % de muestras delante (las muy
+// largas se cortan). Sin `read` (el fuente ya no existe) solo los números
+// de línea.
+void minic_profile_annotate(const MiniCVM *v, MinicReader read, void *rctx, int all,
+                            void (*line)(const char *s, void *ctx), void *ctx){
+  const MinicProfile *pr = v->prof;
+  if(!pr || !pr->period_us) return;
+  int n;
+  uint32_t *hits = prof_line_hits(pr, &n);
+  if(!hits) return;
+  uint32_t total = pr->samples ? pr->samples : 1;
+  char text[80], chunk[64];
+  int ln = 1, len = 0, got;
+  auto emit = [&](void){
+    uint32_t h = ln < n ? hits[ln] : 0;
+    if(all || h){
+      char buf[112];
+      if(h) snprintf(buf, sizeof(buf), "%5.1f%% %5d | %.*s", 100.0 * h / total, ln, len, text);
+      else snprintf(buf, sizeof(buf), "%6s %5d | %.*s", "", ln, len, text);
+      line(buf, ctx);
+    }
+    ln++;
+    len = 0;
+  };
+  if(read){
+    while((got = read(rctx, chunk, sizeof(chunk))) > 0)
+      for(int i = 0; i < got; i++){
+        if(chunk[i] == '\n') emit();
+        else if(chunk[i] != '\r' && len < (int)sizeof(text)) text[len++] = chunk[i];
       }
-      
-      case OP_ARR_LOAD: {
-		Value idx_val = vm.stack[--vm.sp];
-		Value arr_val = vm.stack[--vm.sp];
-		if(arr_val.type != T_ARRAY) {
-			syntax("not an array"); 
-			break;
-		}
-		int idx = value_to_i32(idx_val);
-		if(idx < 0 || idx >= arr_val.arr.length){
-			syntax("index out of bounds"); 
-			break;
-		}
-		Value result;
-		result.type = T_I32;
-		result.i32 = arr_val.arr.array[idx];
-		vm.stack[vm.sp++] = result;
-		break;
-	}
-	case OP_ARR_STORE: {
-		Value value_to_store = vm.stack[vm.sp];
-		Value idx_val = vm.stack[--vm.sp];
-		Value *arr_ref = &vm.stack[vm.sp - 1];
-		
-		if(arr_ref->type != T_ARRAY){
-			syntax("not an array");
-			break;
-		}
-		int idx = value_to_i32(idx_val);
-		if(idx < 0 || idx >= arr_ref->arr.length){
-			syntax("index out of bounds");
-			break;
-		}
-		arr_ref->arr.array[idx] = value_to_i32(value_to_store);
-		break;
-	}
-
-	// Stubs for break, continue - implement as needed
-    case OP_BREAK:
-    case OP_CONTINUE:
-        break;
-      default: printf("Unknown opcode %d\n", op); return;
-    }
-  }
-}
\ No newline at end of file
+    if(len) emit();   // última línea sin '\n'
+  } else {
+    while(ln < n) emit();
+  }
+  free(hits);
+}
+
+// Tablas del perfil, línea a línea: opcodes por ciclos y funciones por
+// tiempo exclusivo, de mayor a menor (con muestreo, las líneas con más
+// muestras)
+void minic_profile_report(const MiniCVM *v, void (*line)(const char *s, void *ctx), void *ctx){
+  const MinicProfile *pr = v->prof;
+  if(!pr) return;
+  if(pr->period_us){
+    prof_report_lines(pr, line, ctx);
+    return;
+  }
+  const MinicProgram *p = v->prog;
+  uint64_t total = pr->clock ? pr->clock : 1;
+  char buf[96];
+  int idx[OP_COUNT > MAX_FUNCS + 1 ? OP_COUNT : MAX_FUNCS + 1];
+  uint64_t key[OP_COUNT > MAX_FUNCS + 1 ? OP_COUNT : MAX_FUNCS + 1];
+
+  snprintf(buf, sizeof(buf), "%-16s %10s %12s %6s %8s", "OPCODE", "EJECUC.", "CICLOS", "%", "CIC/OP");
+  line(buf, ctx);
+  for(int i = 0; i < OP_COUNT; i++) key[i] = pr->op_cycles[i];
+  prof_sort(idx, key, OP_COUNT);
+  for(int i = 0; i < OP_COUNT; i++){
+    int op = idx[i];
+    if(!pr->op_count[op]) continue;
+    snprintf(buf, sizeof(buf), "%-16s %10lu %12llu %5.1f%% %8.1f", op_names[op],
+             (unsigned long)pr->op_count[op], (unsigned long long)pr->op_cycles[op],
+             100.0 * pr->op_cycles[op] / total, (double)pr->op_cycles[op] / pr->op_count[op]);
+    line(buf, ctx);
+  }
+
+  line("", ctx);
+  snprintf(buf, sizeof(buf), "%-20s %8s %12s %12s %6s", "FUNCION", "LLAMADAS", "INCLUSIVO", "EXCLUSIVO", "%");
+  line(buf, ctx);
+  for(int i = 0; i < pr->nfn; i++) key[i] = pr->fn[i].excl;
+  prof_sort(idx, key, pr->nfn);
+  for(int i = 0; i < pr->nfn; i++){
+    const ProfFunc *f = &pr->fn[idx[i]];
+    if(!f->calls && !f->excl) continue;
+    int top = idx[i] == pr->nfn - 1;   // nivel superior: sin llamadas
+    snprintf(buf, sizeof(buf), "%-20s %8lu %12llu %12llu %5.1f%%",
+             top ? "(globals)" : p->funcs[idx[i]].name, (unsigned long)f->calls,
+             (unsigned long long)(top ? f->excl : f->incl), (unsigned long long)f->excl,
+             100.0 * f->excl / total);
+    line(buf, ctx);
+  }
+  snprintf(buf, sizeof(buf), "Total: %llu %s", (unsigned long long)pr->clock,
+#if defined(ARDUINO_ARCH_RP2040)
+           "ciclos");
+#else
+           "ns");
+#endif
+  line(buf, ctx);
+}
+#endif
+
+// Recorre `src` solo con el lexer y devuelve el nº de tokens (incluido
+// TK_END); base del benchmark `minic lex`.
+int minic_lex_count(const char *src){
+  lx_open(src);
+  int n = 0;
+  do { next_tok(); n++; } while(lx.tok != TK_END);
+  return n;
+}
+
+// ---------- CACHE DE BYTECODE (.mcb) ----------
+// Programa ya compilado, guardado junto al fuente (prog.mc -> prog.mcb):
+//   McbHeader | code | funcs | tipos de los globals |
+//   nombres de los globals (len + bytes) | strings (len + bytes) |
+//   tabla de líneas
+// Se reutiliza solo si coinciden el hash del fuente, la huella de
+// native_table (NATIVE_CALL guarda índices) y el formato de la VM.
+#define MCB_MAGIC   0x3142434Du   // "MCB1"
+#define MCB_VERSION 6
+
+typedef struct {
+  uint32_t magic;
+  uint32_t src_hash;
+  uint32_t native_sig;
+  uint16_t code_size;
+  uint16_t string_count;
+  uint16_t line_count;
+  uint8_t version;
+  uint8_t opt;              // minic_opt | minic_lazy << 1 con los que se compiló
+  uint8_t func_count;
+  uint8_t func_size;        // sizeof(Function): cambia con MAX_PARAM...
+  uint8_t global_count;
+} McbHeader;
+
+static uint32_t native_sig(void){
+  uint32_t h = FNV_BASIS;
+  for(int i = 0; i < NATIVE_COUNT; i++)
+    h = (h ^ minic_hash(native_table[i].name, strlen(native_table[i].name)) ^ native_table[i].str_ret ^ native_table[i].arr_args << 8) * FNV_PRIME;
+  return h;
+}
+
+static void mcb_header(McbHeader *h, uint32_t src_hash){
+  memset(h, 0, sizeof(*h));
+  h->magic = MCB_MAGIC;
+  h->version = MCB_VERSION;
+  h->src_hash = src_hash;
+  h->native_sig = native_sig();
+  h->opt = minic_opt | minic_lazy << 1;
+  h->func_size = sizeof(Function);
+}
+
+static int mcb_write(File &f, const void *src, size_t n){
+  return f.write((const uint8_t *)src, n) == n;
+}
+static int mcb_read(File &f, void *dst, size_t n){
+  return (size_t)f.read((uint8_t *)dst, n) == n;
+}
+
+// Guarda el programa `p` en `path`; 0 si no se pudo escribir
+int minic_save(const MinicProgram *p, const char *path, uint32_t src_hash){
+  McbHeader h;
+  mcb_header(&h, src_hash);
+  h.code_size = p->code_size;
+  h.func_count = p->func_count;
+  h.global_count = p->global_count;
+  h.string_count = p->string_count;
+  h.line_count = p->line_count;
+
+  File f = LittleFS.open(path, "w");
+  if(!f) return 0;
+  int ok = mcb_write(f, &h, sizeof(h)) &&
+           mcb_write(f, p->code, p->code_size) &&
+           mcb_write(f, p->funcs, p->func_count * sizeof(Function)) &&
+           mcb_write(f, p->global_types, p->global_count);
+  for(int i = 0; ok && i < p->global_count; i++){
+    uint8_t len = strlen(p->global_names[i]);
+    ok = mcb_write(f, &len, 1) && mcb_write(f, p->global_names[i], len);
+  }
+  for(int i = 0; ok && i < p->string_count; i++){
+    uint8_t len = p->string_pool[i].len;
+    ok = mcb_write(f, &len, 1) && mcb_write(f, p->string_pool[i].ptr, len);
+  }
+  ok = ok && mcb_write(f, p->lines, p->line_count * sizeof(LineEntry));
+  f.close();
+  if(!ok) LittleFS.remove(path);   // nunca dejar una cache a medias
+  return ok;
+}
+
+// ¿`t` es el inicio de una instrucción? (start: marcas de mcb_code_ok())
+static int mcb_target(const uint8_t *start, int n, int t){
+  return t < n && start[t];
+}
+
+// La VM ejecuta el código sin comprobar operandos, así que el de una
+// cache se revisa antes de usarlo: aquí instrucción a instrucción
+// (opcodes, índices de función/nativa/string, saltos y tablas de switch a
+// inicios de instrucción); stack_depths() sigue después cada camino
+// (variables, ventanas y max_depth, que se recalcula).
+static int mcb_code_ok(const MinicProgram *p){
+  const uint8_t *c = p->code;
+  int n = p->code_size, ok = n > 0;
+  uint8_t *start = (uint8_t *)calloc(n + 1, 1);
+  if(!start) return 0;
+  for(int pc = 0; ok && pc < n; pc += 1 + op_len[c[pc]]){
+    uint8_t op = c[pc], a = pc + 1 < n ? c[pc + 1] : 0;
+    if(op >= OP_COUNT || pc + 1 + op_len[op] > n){ ok = 0; break; }
+    start[pc] = 1;
+    switch(op){
+      case OP_PUSH_STR: ok = a < p->string_count; break;
+      case OP_CALL: case OP_TAIL_CALL: ok = a < p->func_count && p->funcs[a].code_start >= 0; break;
+      case OP_NATIVE_CALL: ok = a < NATIVE_COUNT && c[pc + 2] == native_table[a].argc; break;
+      case OP_ARR_NEW: ok = a == T_I8 || a == T_I16 || a == T_I32; break;
+    }
+  }
+  for(int pc = 0; ok && pc < n; pc++){
+    if(!start[pc]) continue;
+    uint8_t op = c[pc];
+    int e = pc + 1 + op_len[op];   // lo que sigue
+    if(op_is_jump(op)) ok = mcb_target(start, n, RD16(c + pc + 1));
+    else if(op == OP_JMP_TABLE){   // n+1 OP_JMP
+      for(int i = 0; ok && i <= RD16(c + pc + 5); i++)
+        ok = mcb_target(start, n, e + 3 * i) && c[e + 3 * i] == OP_JMP;
+    } else if(op == OP_JMP_SEARCH){   // n (PUSH_CONST k; JMP) y el JMP default
+      int k = RD16(c + pc + 1);
+      for(int i = 0; ok && i < k; i++)
+        ok = mcb_target(start, n, e + 8 * i) && c[e + 8 * i] == OP_PUSH_CONST &&
+             mcb_target(start, n, e + 8 * i + 5) && c[e + 8 * i + 5] == OP_JMP;
+      ok = ok && mcb_target(start, n, e + 8 * k) && c[e + 8 * k] == OP_JMP;
+    }
+  }
+  for(int i = 0; ok && i < p->func_count; i++){
+    Function *f = &p->funcs[i];
+    // code_start -1: quitada o, en modo lazy, sin compilar (local_count 0)
+    ok = f->param_count >= 0 && f->param_count <= MAX_PARAM &&
+         (f->code_start == -1 ||
+          (f->code_start >= 0 && mcb_target(start, n, f->code_start) &&
+           f->local_count >= f->param_count && f->local_count <= MAX_VARS));
+    f->name[sizeof(f->name) - 1] = '\0';
+  }
+  free(start);
+  return ok;
+}
+
+// Lo demás que la VM usa tal cual: tipos de los globals y tabla de líneas
+static int mcb_prog_ok(MinicProgram *p){
+  for(int i = 0; i < p->global_count; i++)
+    if(p->global_types[i] > T_BOOL) return 0;
+  for(int i = 0; i < p->line_count; i++)
+    if(p->lines[i].ip > p->code_size || (i && p->lines[i].ip < p->lines[i - 1].ip)) return 0;
+  return mcb_code_ok(p) && stack_depths(p);
+}
+
+// string de `len` bytes del .mcb, copiada a la arena del programa
+static char *mcb_read_str(File &f, uint8_t len){
+  char *str = (char *)arena_alloc(len + 1);
+  str[len] = '\0';
+  return mcb_read(f, str, len) ? str : NULL;
+}
+
+// Carga `path` si corresponde a este fuente; NULL si no existe o no vale
+MinicProgram *minic_load(const char *path, uint32_t src_hash){
+  File f = LittleFS.open(path, "r");
+  if(!f) return NULL;
+  McbHeader want, h;
+  mcb_header(&want, src_hash);
+  int ok = mcb_read(f, &h, sizeof(h)) &&
+           h.magic == want.magic && h.version == want.version &&
+           h.src_hash == want.src_hash && h.native_sig == want.native_sig &&
+           h.opt == want.opt && h.func_size == want.func_size &&
+           h.code_size <= MAX_CODE && h.func_count <= MAX_FUNCS &&
+           h.global_count <= MAX_VARS && h.string_count <= MAX_STR_POOL &&
+           h.line_count <= h.code_size;
+  if(!ok){
+    // no corresponde: se recompila
+  } else if(setjmp(compile_fail)){   // sin memoria en arena_alloc()
+    ok = 0;
+  } else if((prog = (MinicProgram *)calloc(1, sizeof(MinicProgram))) != NULL){
+    // los tamaños ya se conocen: cada segmento se pide justo a la arena
+    prog->code = (uint8_t *)arena_alloc(h.code_size);
+    prog->code_size = prog->code_cap = h.code_size;
+    prog->funcs = (Function *)arena_alloc(h.func_count * sizeof(Function));
+    prog->func_count = prog->func_cap = h.func_count;
+    prog->string_pool = (VmString *)arena_alloc(h.string_count * sizeof(VmString));
+    prog->string_cap = h.string_count;
+    prog->lines = (LineEntry *)arena_alloc(h.line_count * sizeof(LineEntry));
+    prog->line_count = prog->line_cap = h.line_count;
+    prog->global_count = h.global_count;
+    ok = mcb_read(f, prog->code, h.code_size) &&
+         mcb_read(f, prog->funcs, h.func_count * sizeof(Function)) &&
+         mcb_read(f, prog->global_types, h.global_count);
+    for(int i = 0; ok && i < h.global_count; i++){
+      uint8_t len;
+      ok = mcb_read(f, &len, 1) && (prog->global_names[i] = mcb_read_str(f, len)) != NULL;
+    }
+    for(int i = 0; ok && i < h.string_count; i++){
+      uint8_t len;
+      char *str;
+      ok = mcb_read(f, &len, 1) && (str = mcb_read_str(f, len)) != NULL;
+      if(ok) prog->string_pool[prog->string_count++] = (VmString){ str, len, 0, STR_NONE };
+    }
+    ok = ok && mcb_read(f, prog->lines, h.line_count * sizeof(LineEntry)) &&
+         mcb_prog_ok(prog);
+  } else {
+    ok = 0;
+  }
+  f.close();
+  MinicProgram *p = prog;
+  prog = NULL;
+  if(!ok){
+    minic_program_free(p);
+    return NULL;
+  }
+  return p;
+}
+
+// Programa del archivo abierto `src`: de la cache `mcb_path` si está al
+// día (*hit = 1) o compilado directamente del archivo, sin cargarlo en
+// memoria, regenerando la cache (mcb_path NULL = sin cache). El hash para
+// la cache se calcula en una primera lectura por bloques. NULL si falla.
+MinicProgram *minic_open_file(File &src, const char *mcb_path, int *hit){
+  uint32_t hash = FNV_BASIS;
+  MinicProgram *p = NULL;
+  if(mcb_path){
+    char buf[64];
+    int n;
+    while((n = src.read((uint8_t *)buf, sizeof(buf))) > 0) hash = minic_hash(buf, n, hash);
+    p = minic_load(mcb_path, hash);
+  }
+  *hit = p != NULL;
+  if(!p){
+    src.seek(0);
+    p = minic_compile_stream(file_reader, &src, file_seek);
+    if(p && mcb_path) minic_save(p, mcb_path, hash);
+  }
+  return p;
+}
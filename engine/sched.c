@@ -0,0 +1,191 @@
+#include "sched.h"
+#include "../io.h"
+
+// Se compila dentro de commands.cpp tras mini_c.c (usa vm_exec() y
+// compañía directamente).
+
+Task tasks[MAX_TASKS];
+int32_t sched_slice_ticks = TASK_SLICE;
+uint32_t sched_slice_us = TASK_SLICE_US;
+uint32_t loop_lat_max_us;
+static int next_task_id = 1;
+static int cur_task = -1;   // última que tuvo turno (round robin)
+
+#if MINIC_PROFILE
+static void prof_line(const char *s, void *ctx){
+  File *f = (File *)ctx;
+  outPrintln(s);
+  if(*f){
+    f->print(s);
+    f->print("\n");
+  }
+}
+
+static void prof_console_line(const char *s, void *ctx){
+  outPrintln(s);
+}
+
+static void prof_file_line(const char *s, void *ctx){
+  File *f = (File *)ctx;
+  f->print(s);
+  f->print("\n");
+}
+
+// Al acabar una ejecución perfilada: las tablas en la consola y en
+// /sys/<script>.prof. Con muestreo, además el fuente anotado: en la
+// consola solo las líneas con muestras, en el archivo entero.
+static void task_profile_report(const MiniCVM *v, const char *name){
+  const char *base = strrchr(name, '/');
+  base = base ? base + 1 : name;
+  char path[48];
+  snprintf(path, sizeof(path), "/sys/%.*s.prof", (int)strcspn(base, "."), base);
+  File f = LittleFS.open(path, "w");
+  outPrintln("----------------------------------------");
+  minic_profile_report(v, prof_line, &f);
+  if(v->prof->period_us){
+    File src = LittleFS.open(name, "r");   // código directo ("minic"): no hay fuente
+    outPrintln("");
+    minic_profile_annotate(v, src ? file_reader : NULL, &src, 0, prof_console_line, NULL);
+    if(f){
+      f.print("\n");
+      src.seek(0);
+      minic_profile_annotate(v, src ? file_reader : NULL, &src, 1, prof_file_line, &f);
+    }
+    if(src) src.close();
+  }
+  if(f){
+    f.close();
+    outPrintf("Perfil guardado en %s\n", path);
+  }
+}
+#endif
+
+static void task_free(Task *t){
+  minic_vm_free(t->inst);
+  minic_program_free(t->prog);
+  memset(t, 0, sizeof(*t));
+}
+
+int sched_spawn(const char *name, MinicProgram *p, uint8_t quota, uint8_t fg, uint8_t profile){
+  Task *t = NULL;
+  for(int i = 0; i < MAX_TASKS && !t; i++)
+    if(tasks[i].state == TASK_FREE) t = &tasks[i];
+  MiniCVM *v = t ? vm_alloc(p) : NULL;
+  if(!v){
+    minic_program_free(p);
+    return -1;
+  }
+  v->sched = 1;
+#if MINIC_PROFILE
+  if(profile && minic_profile_start(v, profile == PROF_SAMPLE ? PROF_SAMPLE_US : 0) < 0)
+    outPrintln("Aviso: no se puede perfilar (¿otro muestreo en curso?)");
+#endif
+  t->state = TASK_READY;
+  t->in_main = 0;
+  t->fg = fg;
+  t->web = isWebCommand;
+  t->quota = quota == 0 || quota > 100 ? 100 : quota;
+  t->id = next_task_id++;
+  strncpy(t->name, name, TASK_NAME - 1);
+  t->name[TASK_NAME - 1] = '\0';
+  t->prog = p;
+  t->inst = v;
+  t->start_ms = t->win_ms = millis();
+  t->cpu_us = 0;
+  t->slices = 0;
+  t->win_us = 0;
+  return t->id;
+}
+
+int sched_kill(int id){
+  for(int i = 0; i < MAX_TASKS; i++)
+    if(tasks[i].state != TASK_FREE && tasks[i].id == id){
+      task_free(&tasks[i]);
+      return 0;
+    }
+  return -1;
+}
+
+int sched_foreground(void){
+  for(int i = 0; i < MAX_TASKS; i++)
+    if(tasks[i].state != TASK_FREE && tasks[i].fg) return tasks[i].id;
+  return 0;
+}
+
+static void task_end(Task *t, int ok){
+  if(t->fg){
+    outPrintln("----------------------------------------");
+    outPrintln(ok ? "[MiniC finalizado]" : "[MiniC finalizado con errores]");
+  } else {
+    outPrintf("[%d] %s: %s\n", t->id, t->name, ok ? "terminada" : "terminada con errores");
+  }
+#if MINIC_PROFILE
+  if(t->inst->prof) task_profile_report(t->inst, t->name);
+#endif
+  task_free(t);
+}
+
+// Un turno de `t`, en tramos de TASK_CHUNK ticks hasta gastar el
+// presupuesto de ticks o de tiempo. Al acabar la inicialización de los
+// globals se arma la llamada a main() sobre la misma instancia; al volver
+// main() la tarea termina.
+static void task_slice(Task *t){
+  MiniCVM *v = t->inst;
+  uint32_t t0 = micros(), used;
+  int32_t left = sched_slice_ticks;
+  int st;
+  do {
+    int32_t n = left < TASK_CHUNK ? left : TASK_CHUNK;
+    st = vm_exec(v, n);
+    left -= n;
+    used = micros() - t0;
+  } while(st == VM_PREEMPTED && left > 0 && used < sched_slice_us);
+  t->cpu_us += used;
+  t->win_us += used;
+  t->slices++;
+
+  if(st == VM_FAULTED){
+    task_end(t, 0);
+  } else if(st == VM_HALTED){
+    int fi = minic_func(t->prog, "main");
+    v->sp = 0;
+    if(t->in_main || fi < 0) task_end(t, 1);
+    else if(vm_enter(v, fi, NULL, 0) < 0) task_end(t, 0);
+    else t->in_main = 1;
+  } else if(st == VM_YIELDED && (int32_t)(v->wake_ms - millis()) > 0){
+    t->state = TASK_SLEEP;
+  }
+}
+
+// Ya gastó su cuota de CPU en la ventana actual
+static int task_throttled(Task *t, uint32_t now){
+  if(t->quota >= 100) return 0;
+  if(now - t->win_ms >= TASK_QUOTA_MS){
+    t->win_ms = now;
+    t->win_us = 0;
+  }
+  return t->win_us >= (uint32_t)t->quota * TASK_QUOTA_MS * 10;
+}
+
+void sched_run(void){
+  uint32_t now = millis();
+  for(int n = 0; n < MAX_TASKS; n++){
+    cur_task = (cur_task + 1) % MAX_TASKS;
+    Task *t = &tasks[cur_task];
+    if(t->state == TASK_SLEEP && (int32_t)(now - t->inst->wake_ms) >= 0) t->state = TASK_READY;
+    if(t->state == TASK_READY && !task_throttled(t, now)){
+      bool web = isWebCommand;   // la salida va a la terminal que la lanzó
+      isWebCommand = t->web;
+      task_slice(t);
+      isWebCommand = web;
+      return;
+    }
+  }
+}
+
+void sched_loop_mark(void){
+  static uint32_t last;
+  uint32_t now = micros();
+  if(last && now - last > loop_lat_max_us) loop_lat_max_us = now - last;
+  last = now;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "vm.h"
+
+// -------- Planificador de tareas MiniC --------
+// Cada tarea es un programa con su propia instancia. loop() llama a
+// sched_run(), que da un turno a la siguiente tarea lista: corre hasta
+// yield(), sleep(), sched_slice_ticks ticks (saltos y llamadas) o
+// sched_slice_us microsegundos, lo que llegue antes, y vuelve.
+#define MAX_TASKS        4
+#define TASK_SLICE       1000   // ticks por turno (por defecto)
+#define TASK_SLICE_US    2000   // tope de tiempo por turno (por defecto)
+#define TASK_CHUNK       128    // ticks entre consultas al reloj
+#define TASK_QUOTA_MS    100    // ventana en la que se mide la cuota
+#define TASK_NAME        24
+
+typedef enum {
+  TASK_FREE,
+  TASK_READY,
+  TASK_SLEEP,    // en sleep() hasta vm->wake_ms
+} TaskState;
+
+typedef struct {
+  uint8_t state;
+  uint8_t in_main;     // 0 = aún inicializando los globals
+  uint8_t fg;          // en primer plano: la shell espera a que acabe
+  uint8_t web;         // lanzada desde la terminal web (salida ahí)
+  uint8_t quota;       // % de CPU por ventana de TASK_QUOTA_MS; 100 = sin límite
+  int id;              // visible en ps / kill
+  char name[TASK_NAME];
+  MinicProgram *prog;  // propiedad de la tarea
+  MiniCVM *inst;
+  uint32_t start_ms;
+  uint64_t cpu_us;     // tiempo de CPU acumulado en sus turnos
+  uint32_t slices;
+  uint32_t win_ms;     // ventana de cuota en curso y CPU gastada en ella
+  uint32_t win_us;
+} Task;
+
+extern Task tasks[MAX_TASKS];
+extern int32_t sched_slice_ticks;
+extern uint32_t sched_slice_us;
+extern uint32_t loop_lat_max_us;   // peor tiempo entre dos pasadas de loop()
+
+// id; -1 (p liberado) si no hay sitio. fg: la tarea de primer plano (una);
+// profile: PROF_EXACT / PROF_SAMPLE (MINIC_PROFILE) e informar al acabar
+int sched_spawn(const char *name, MinicProgram *p, uint8_t quota, uint8_t fg, uint8_t profile);
+int sched_kill(int id);          // 0 = ok, -1 si no existe
+int sched_foreground(void);      // id de la tarea en primer plano; 0 = ninguna
+void sched_run(void);            // un turno; desde loop()
+void sched_loop_mark(void);      // al entrar en loop(): mide loop_lat_max_us
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// -------- Cola SPSC --------
+// Cola lock-free de un solo productor y un solo consumidor, para pasar
+// datos entre los dos núcleos (o dos hilos en Linux). Cada índice lo
+// escribe un solo lado: head el productor y tail el consumidor, así que
+// bastan cargas y escrituras atómicas (el M0+ no tiene LDREX/STREX).
+// N debe ser potencia de 2; los índices corren libres y se enmascaran.
+template <typename T, uint32_t N>
+struct Spsc {
+  static_assert(N && (N & (N - 1)) == 0, "N debe ser potencia de 2");
+
+  T buf[N];
+  std::atomic<uint32_t> head{0};   // próximo hueco a escribir
+  std::atomic<uint32_t> tail{0};   // próximo elemento a leer
+
+  // productor; false si está llena
+  bool push(const T &v){
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if(h - tail.load(std::memory_order_acquire) == N) return false;
+    buf[h & (N - 1)] = v;
+    head.store(h + 1, std::memory_order_release);   // publica buf[h]
+    return true;
+  }
+
+  // consumidor; false si está vacía
+  bool pop(T &v){
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if(t == head.load(std::memory_order_acquire)) return false;
+    v = buf[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);   // libera el hueco
+    return true;
+  }
+
+  bool empty() const {
+    return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+  }
+};
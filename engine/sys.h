@@ -13,10 +13,198 @@ typedef struct {
   const char *name;
   NativeFn fn;
   int argc;
+  uint8_t str_ret;   // 1: devuelve un handle de string; si no, int32
+  uint8_t core0;     // 1: usa periféricos o FS del núcleo 0 (ver core1.c)
+  uint8_t arr_args;  // bit i: el argumento i es un array (ver OP_NATIVE_CALL)
 } NativeEntry;
 
-static inline const char *vm_get_str(int32_t v){
-  return vm.string_pool[v & ~(1<<30)];
+// Una nativa que no puede seguir llama a vm_fault() (mini_c.c) y
+// OP_NATIVE_CALL abandona la llamada, como con un error del intérprete
+static void vm_fault(const char *msg);
+
+// ---------------- Strings -------------
+// Las nativas reciben los strings como handle etiquetado con STR_TAG (ver
+// OP_NATIVE_CALL) y devuelven los nuevos como handle sin etiquetar.
+#define STR_TAG (1 << 30)
+
+static const VmString str_empty = { "", 0, 0, STR_NONE };
+
+// handle -> string; uno inválido (o un entero) se ve como ""
+static inline const VmString *vm_str(int32_t v){
+  MiniCVM *self = minic_vm();
+  v &= ~STR_TAG;
+  if(v >= 0 && v < self->prog->string_count) return &self->prog->string_pool[v];
+  if(v >= STR_DYN && v < STR_DYN + MAX_DYN_STR && self->dyn[v - STR_DYN].ptr)
+    return &self->dyn[v - STR_DYN];
+  return &str_empty;
+}
+
+// Versión terminada en '\0' para las APIs de C: literales y strings
+// propias ya lo están; un trozo se copia (hasta MAX_STRING bytes) a `buf`,
+// de MAX_STRING + 1 bytes, que pone quien llama (en su pila: ningún
+// buffer compartido entre llamadas ni entre núcleos).
+static const char *vm_get_str(int32_t v, char *buf){
+  const VmString *s = vm_str(v);
+  if(s->ptr[s->len] == '\0') return s->ptr;
+  size_t n = s->len < MAX_STRING ? s->len : MAX_STRING;
+  memcpy(buf, s->ptr, n);
+  buf[n] = '\0';
+  return buf;
+}
+
+static void str_free(int i){
+  MiniCVM *self = minic_vm();
+  VmString *s = &self->dyn[i];
+  if(s->owner < MAX_DYN_STR) self->dyn[s->owner].refs--;
+  else if(s->owner == STR_NONE) free((void *)s->ptr);
+  s->ptr = NULL;
+}
+
+static void str_mark(uint8_t *live, const Value *v, int n){
+  for(int i = 0; i < n; i++){
+    // un registro de retorno (type = función) puede parecer un T_STRING:
+    // solo se conserva de más, nunca se libera algo vivo
+    int32_t h = v[i].i32 - STR_DYN;
+    if(v[i].type == T_STRING && h >= 0 && h < MAX_DYN_STR) live[h] = 1;
+  }
+}
+
+// Recupera las strings de ejecución que ya nadie usa. Las raíces son los
+// globals y la pila hasta su sp (operandos y ventanas de locals); las
+// referencias entre strings (trozo -> dueño) van contadas en refs.
+static void str_collect(void){
+  MiniCVM *self = minic_vm();
+  uint8_t live[MAX_DYN_STR] = {0};
+  str_mark(live, self->globals, self->prog->global_count);
+  str_mark(live, self->stack, self->sp);
+  for(int i = 0; i < MAX_DYN_STR; i++)   // trozos primero: sueltan a su dueño
+    if(self->dyn[i].ptr && !live[i] && self->dyn[i].owner != STR_NONE) str_free(i);
+  for(int i = 0; i < MAX_DYN_STR; i++)
+    if(self->dyn[i].ptr && !live[i] && self->dyn[i].refs == 0) str_free(i);
+}
+
+static int str_slot(void){
+  MiniCVM *self = minic_vm();
+  for(int pass = 0; pass < 2; pass++){
+    for(int i = 0; i < MAX_DYN_STR; i++)
+      if(!self->dyn[i].ptr) return i;
+    str_collect();
+  }
+  return -1;
+}
+
+// Nueva string propia con `len` bytes sin inicializar; -1 si no hay sitio
+static int str_alloc(uint16_t len, char **bytes){
+  int i = str_slot();
+  if(i < 0) return -1;
+  char *p = (char *)malloc(len + 1);
+  if(!p) return -1;
+  p[len] = '\0';
+  minic_vm()->dyn[i] = (VmString){ p, len, 0, STR_NONE };
+  *bytes = p;
+  return STR_DYN + i;
+}
+
+// Trozo [start, start+len) de `v` sin copiar (ya recortado)
+static int str_slice(int32_t v, int start, int len){
+  MiniCVM *self = minic_vm();
+  const VmString *s = vm_str(v);
+  int32_t h = v & ~STR_TAG;
+  uint8_t owner = s->owner;   // de un trozo se cuelga directamente del dueño
+  if(h < STR_DYN || s == &str_empty){
+    if(start == 0 && len == s->len) return h;   // entero: mismo handle
+    owner = STR_LITERAL;
+  } else if(owner == STR_NONE)
+    owner = (uint8_t)(h - STR_DYN);
+  const char *ptr = s->ptr + start;   // antes de str_slot(): puede recolectar
+  if(owner < MAX_DYN_STR) self->dyn[owner].refs++;
+  int i = str_slot();
+  if(i < 0){
+    if(owner < MAX_DYN_STR) self->dyn[owner].refs--;
+    return -1;
+  }
+  self->dyn[i] = (VmString){ ptr, (uint16_t)len, 0, owner };
+  return STR_DYN + i;
+}
+
+// Al destruir la instancia: todas sus strings de ejecución a la vez
+static void str_release(MiniCVM *v){
+  for(int i = 0; i < MAX_DYN_STR; i++)
+    if(v->dyn[i].ptr && v->dyn[i].owner == STR_NONE) free((void *)v->dyn[i].ptr);
+  memset(v->dyn, 0, sizeof(v->dyn));
+}
+
+// ---------------- Arrays --------------
+// Las nativas declaran en arr_args qué argumentos son arrays: el
+// compilador rechaza otra cosa y OP_NATIVE_CALL comprueba el tipo de los
+// que no conoce, así que ahí solo llega el índice de un array.
+
+// Palabra de 32 bits sobre los bytes de un array de cualquier ancho: los
+// bucles de las nativas leen y escriben de 4 en 4 bytes y separan los
+// elementos con desplazamientos (little-endian, como el RP2040)
+typedef uint32_t __attribute__((may_alias)) arr_word;
+
+static inline int arr_width(uint8_t t){ return t == T_I8 ? 1 : t == T_I16 ? 2 : 4; }
+
+// handle -> array; NULL si ya no existe
+static inline VmArray *vm_arr(int32_t v){
+  MiniCVM *self = minic_vm();
+  return v >= 0 && v < MAX_ARRAYS && self->arrays[v].data ? &self->arrays[v] : NULL;
+}
+
+static inline int32_t arr_get(const VmArray *a, int i){
+  switch(a->type){
+    case T_I8:  return ((const int8_t *)a->data)[i];
+    case T_I16: return ((const int16_t *)a->data)[i];
+    default:    return ((const int32_t *)a->data)[i];
+  }
+}
+
+static inline void arr_set(VmArray *a, int i, int32_t v){
+  switch(a->type){
+    case T_I8:  ((int8_t *)a->data)[i] = (int8_t)v; break;
+    case T_I16: ((int16_t *)a->data)[i] = (int16_t)v; break;
+    default:    ((int32_t *)a->data)[i] = v; break;
+  }
+}
+
+// Recupera los arrays que ya nadie nombra; raíces como en str_collect()
+static void arr_collect(void){
+  MiniCVM *self = minic_vm();
+  uint8_t live[MAX_ARRAYS] = {0};
+  const Value *roots[2] = { self->globals, self->stack };
+  int n[2] = { self->prog->global_count, self->sp };
+  for(int r = 0; r < 2; r++)
+    for(int i = 0; i < n[r]; i++)
+      if(roots[r][i].type == T_ARRAY && (uint32_t)roots[r][i].i32 < MAX_ARRAYS) live[roots[r][i].i32] = 1;
+  for(int i = 0; i < MAX_ARRAYS; i++)
+    if(self->arrays[i].data && !live[i]){
+      free(self->arrays[i].data);
+      self->arrays[i].data = NULL;
+    }
+}
+
+// Nuevo array de `n` elementos a 0; -1 si no hay sitio. El bloque se
+// redondea a palabras enteras.
+static int arr_new(uint8_t type, int n){
+  MiniCVM *self = minic_vm();
+  size_t bytes = ((size_t)n * arr_width(type) + 3) & ~(size_t)3;
+  for(int pass = 0; pass < 2; pass++){
+    int i = 0;
+    while(i < MAX_ARRAYS && self->arrays[i].data) i++;
+    void *p = i < MAX_ARRAYS ? calloc(bytes ? bytes : 4, 1) : NULL;
+    if(p){
+      self->arrays[i] = (VmArray){ p, (uint16_t)n, type };
+      return i;
+    }
+    arr_collect();
+  }
+  return -1;
+}
+
+static void arr_release(MiniCVM *v){
+  for(int i = 0; i < MAX_ARRAYS; i++) free(v->arrays[i].data);
+  memset(v->arrays, 0, sizeof(v->arrays));
 }
 
 // ---------------- GPIO ----------------
@@ -35,8 +223,15 @@ int32_t fn_gpio_read(int32_t *a,int c){
 }
 
 // ---------------- Delay / Time --------
+// En una tarea del planificador no bloquea: cede el turno hasta wake_ms
 int32_t fn_sleep(int32_t *a,int c){
-  delay(a[0]);
+  MiniCVM *self = minic_vm();
+  if(self->sched){
+    self->wake_ms = millis() + (uint32_t)a[0];
+    self->yield = 1;
+  } else {
+    delay(a[0]);
+  }
   return 0;
 }
 
@@ -118,17 +313,19 @@ int32_t fn_spi_transfer(int32_t *a,int c){
 
 // ---------------- FS (LittleFS) -------
 int32_t fn_fs_write(int32_t *a,int c){  
-  const char *path = vm_get_str(a[0]);
-  const char *data = vm_get_str(a[1]);
+  char buf[MAX_STRING + 1];
+  const char *path = vm_get_str(a[0], buf);
+  const VmString *data = vm_str(a[1]);
   File f = LittleFS.open(path, "w");
   if(!f) return -1;
-  f.print(data);
+  f.write((const uint8_t *)data->ptr, data->len);
   f.close();
   return 0;
 }
 
 int32_t fn_fs_read(int32_t *a,int c){  
-  const char *path = vm_get_str(a[0]);
+  char buf[MAX_STRING + 1];
+  const char *path = vm_get_str(a[0], buf);
   File f = LittleFS.open(path, "r");
   if(!f) return -1;
   String s = f.readString();
@@ -136,16 +333,187 @@ int32_t fn_fs_read(int32_t *a,int c){
   return (int32_t)s.length();
 }
 
-// ---------------- Scheduler Flag ------
-volatile uint32_t sys_yield_flag = 0;
+// ---------------- Strings -------------
+int32_t fn_str_len(int32_t *a,int c){
+  return vm_str(a[0])->len;
+}
+
+// Sin sitio para la string nueva la llamada falla (vm_fault()): un -1
+// como handle se vería como "" y el programa seguiría con datos perdidos
+int32_t fn_str_cat(int32_t *a,int c){
+  const VmString *x = vm_str(a[0]), *y = vm_str(a[1]);
+  if(x->len + y->len > 0xFFFF){ vm_fault("string too long"); return 0; }
+  char *p;
+  int h = str_alloc(x->len + y->len, &p);   // x, y siguen en la pila: vivas
+  if(h < 0){ vm_fault("out of string memory"); return 0; }
+  memcpy(p, x->ptr, x->len);
+  memcpy(p + x->len, y->ptr, y->len);
+  return h;
+}
+
+int32_t fn_str_sub(int32_t *a,int c){   // str_sub(s, inicio, longitud)
+  int n = vm_str(a[0])->len;
+  int start = a[1] < 0 ? 0 : a[1] > n ? n : a[1];
+  int len = a[2] < 0 ? 0 : a[2] > n - start ? n - start : a[2];
+  int h = str_slice(a[0], start, len);
+  if(h < 0) vm_fault("out of string memory");
+  return h < 0 ? 0 : h;
+}
+
+int32_t fn_str_cmp(int32_t *a,int c){   // <0, 0, >0 como strcmp
+  if((a[0] & ~STR_TAG) == (a[1] & ~STR_TAG)) return 0;   // mismo handle
+  const VmString *x = vm_str(a[0]), *y = vm_str(a[1]);
+  int r = memcmp(x->ptr, y->ptr, x->len < y->len ? x->len : y->len);
+  if(r) return r < 0 ? -1 : 1;
+  return x->len < y->len ? -1 : x->len > y->len;
+}
+
+// ---------------- Arrays --------------
+// Operan sobre el array entero (los argumentos array ya vienen comprobados)
+int32_t fn_arr_len(int32_t *a,int c){
+  VmArray *x = vm_arr(a[0]);
+  return x ? x->length : -1;
+}
+
+int32_t fn_arr_fill(int32_t *a,int c){   // arr_fill(a, valor)
+  VmArray *x = vm_arr(a[0]);
+  if(!x) return -1;
+  int w = arr_width(x->type), n = x->length, words = n * w / 4;
+  uint32_t v = w == 1 ? (uint8_t)a[1] * 0x01010101u
+             : w == 2 ? (uint16_t)a[1] * 0x00010001u : (uint32_t)a[1];
+  arr_word *p = (arr_word *)x->data;
+  for(int i = 0; i < words; i++) p[i] = v;
+  for(int i = words * 4 / w; i < n; i++) arr_set(x, i, a[1]);
+  return n;
+}
+
+int32_t fn_arr_copy(int32_t *a,int c){   // arr_copy(destino, origen): min(longitudes)
+  VmArray *d = vm_arr(a[0]), *s = vm_arr(a[1]);
+  if(!d || !s) return -1;
+  int n = d->length < s->length ? d->length : s->length;
+  if(d->type == s->type) memmove(d->data, s->data, (size_t)n * arr_width(d->type));
+  else for(int i = 0; i < n; i++) arr_set(d, i, arr_get(s, i));   // convierte el ancho
+  return n;
+}
 
+int32_t fn_arr_sum(int32_t *a,int c){   // suma en int32 (da la vuelta como +)
+  VmArray *x = vm_arr(a[0]);
+  if(!x) return -1;
+  int w = arr_width(x->type), n = x->length, words = n * w / 4;
+  const arr_word *p = (const arr_word *)x->data;
+  uint32_t s = 0;
+  if(w == 1){
+    for(int i = 0; i < words; i++){
+      uint32_t v = p[i];
+      s += (int8_t)v + (int8_t)(v >> 8) + (int8_t)(v >> 16) + (int8_t)(v >> 24);
+    }
+  } else if(w == 2){
+    for(int i = 0; i < words; i++){
+      uint32_t v = p[i];
+      s += (int16_t)v + (int16_t)(v >> 16);
+    }
+  } else {
+    for(int i = 0; i < words; i++) s += p[i];
+  }
+  for(int i = words * 4 / w; i < n; i++) s += arr_get(x, i);
+  return (int32_t)s;
+}
+
+// mínimo (max = 0) o máximo (max = 1); 0 si está vacío
+static int32_t arr_extreme(VmArray *x, int max){
+  int w = arr_width(x->type), n = x->length, words = n * w / 4;
+  if(!n) return 0;
+  const arr_word *p = (const arr_word *)x->data;
+  int32_t m = arr_get(x, 0);
+#define ARR_PICK(e) do { int32_t e_ = (e); if(max ? e_ > m : e_ < m) m = e_; } while(0)
+  if(w == 1){
+    for(int i = 0; i < words; i++){
+      uint32_t v = p[i];
+      ARR_PICK((int8_t)v); ARR_PICK((int8_t)(v >> 8));
+      ARR_PICK((int8_t)(v >> 16)); ARR_PICK((int8_t)(v >> 24));
+    }
+  } else if(w == 2){
+    for(int i = 0; i < words; i++){
+      uint32_t v = p[i];
+      ARR_PICK((int16_t)v); ARR_PICK((int16_t)(v >> 16));
+    }
+  } else {
+    for(int i = 0; i < words; i++) ARR_PICK((int32_t)p[i]);
+  }
+  for(int i = words * 4 / w; i < n; i++) ARR_PICK(arr_get(x, i));
+#undef ARR_PICK
+  return m;
+}
+
+int32_t fn_arr_min(int32_t *a,int c){
+  VmArray *x = vm_arr(a[0]);
+  return x ? arr_extreme(x, 0) : -1;
+}
+
+int32_t fn_arr_max(int32_t *a,int c){
+  VmArray *x = vm_arr(a[0]);
+  return x ? arr_extreme(x, 1) : -1;
+}
+
+int32_t fn_arr_dot(int32_t *a,int c){   // producto escalar en int32 sobre min(longitudes)
+  VmArray *x = vm_arr(a[0]), *y = vm_arr(a[1]);
+  if(!x || !y) return -1;
+  int n = x->length < y->length ? x->length : y->length, done = 0;
+  uint32_t s = 0;
+  if(x->type == y->type && x->type != T_I32){   // mismo ancho: de palabra en palabra
+    const arr_word *p = (const arr_word *)x->data, *q = (const arr_word *)y->data;
+    int w = arr_width(x->type), words = n * w / 4;
+    for(int i = 0; i < words; i++){
+      uint32_t u = p[i], v = q[i];
+      if(w == 1)
+        s += (int8_t)u * (int8_t)v + (int8_t)(u >> 8) * (int8_t)(v >> 8) +
+             (int8_t)(u >> 16) * (int8_t)(v >> 16) + (int8_t)(u >> 24) * (int8_t)(v >> 24);
+      else
+        s += (uint32_t)((int16_t)u * (int16_t)v) + (uint32_t)((int16_t)(u >> 16) * (int16_t)(v >> 16));
+    }
+    done = words * 4 / w;
+  }
+  for(int i = done; i < n; i++) s += (uint32_t)arr_get(x, i) * (uint32_t)arr_get(y, i);
+  return (int32_t)s;
+}
+
+// arr_avg(destino, origen, ventana): media móvil. destino[i] = media de
+// origen[i-ventana+1 .. i] (de los que haya al principio), con una suma
+// que avanza en vez de resumar la ventana. Arrays distintos.
+int32_t fn_arr_avg(int32_t *a,int c){
+  VmArray *d = vm_arr(a[0]), *s = vm_arr(a[1]);
+  int win = a[2];
+  if(!d || !s || d == s || win < 1) return -1;
+  int n = d->length < s->length ? d->length : s->length;
+  if(win > n) win = n ? n : 1;
+  if(s->type != T_I32){   // 65535 elementos de 16 bits caben en int32: sin división de 64 bits
+    int32_t sum = 0;
+    for(int i = 0; i < n; i++){
+      sum += arr_get(s, i);
+      if(i >= win) sum -= arr_get(s, i - win);
+      arr_set(d, i, sum / (i < win ? i + 1 : win));
+    }
+  } else {
+    int64_t sum = 0;
+    for(int i = 0; i < n; i++){
+      sum += arr_get(s, i);
+      if(i >= win) sum -= arr_get(s, i - win);
+      arr_set(d, i, (int32_t)(sum / (i < win ? i + 1 : win)));
+    }
+  }
+  return n;
+}
+
+// ---------------- Scheduler Flag ------
+// Por instancia (cada núcleo corre la suya): vm_exec() lo mira tras cada
+// nativa, cede el turno y lo vuelve a 0
 int32_t fn_yield(int32_t *a,int c){
-  sys_yield_flag = 1;
+  minic_vm()->yield = 1;
   return 0;
 }
 
 // -------- Tabla Nativa -----------------
-static NativeEntry native_table[] = {
+static constexpr NativeEntry native_table[] = {
   { "gpio_mode",   fn_gpio_mode,   2 },
   { "gpio_write",  fn_gpio_write,  2 },
   { "gpio_read",   fn_gpio_read,   1 },
@@ -159,19 +527,33 @@ static NativeEntry native_table[] = {
   { "pwm_attach",  fn_pwm_attach,  1 },
   { "pwm_write",   fn_pwm_write,   2 },
 
-  { "uart_begin",  fn_uart_begin,  1 },
-  { "uart_write",  fn_uart_write,  1 },
-  { "uart_read",   fn_uart_read,   0 },
-
-  { "i2c_begin",   fn_i2c_begin,   2 },
-  { "i2c_write",   fn_i2c_write,   3 },
-  { "i2c_read",    fn_i2c_read,    2 },
-
-  { "spi_begin",   fn_spi_begin,   0 },
-  { "spi_xfer",    fn_spi_transfer,1 },
-
-  { "fs_write",    fn_fs_write,    2 },
-  { "fs_read",     fn_fs_read,     1 },
+  { "uart_begin",  fn_uart_begin,  1, 0, 1 },
+  { "uart_write",  fn_uart_write,  1, 0, 1 },
+  { "uart_read",   fn_uart_read,   0, 0, 1 },
+
+  { "i2c_begin",   fn_i2c_begin,   2, 0, 1 },
+  { "i2c_write",   fn_i2c_write,   3, 0, 1 },
+  { "i2c_read",    fn_i2c_read,    2, 0, 1 },
+
+  { "spi_begin",   fn_spi_begin,   0, 0, 1 },
+  { "spi_xfer",    fn_spi_transfer,1, 0, 1 },
+
+  { "fs_write",    fn_fs_write,    2, 0, 1 },
+  { "fs_read",     fn_fs_read,     1, 0, 1 },
+
+  { "str_len",     fn_str_len,     1 },
+  { "str_cat",     fn_str_cat,     2, 1 },
+  { "str_sub",     fn_str_sub,     3, 1 },
+  { "str_cmp",     fn_str_cmp,     2 },
+
+  { "arr_len",     fn_arr_len,     1, 0, 0, 0x1 },
+  { "arr_fill",    fn_arr_fill,    2, 0, 0, 0x1 },
+  { "arr_copy",    fn_arr_copy,    2, 0, 0, 0x3 },
+  { "arr_sum",     fn_arr_sum,     1, 0, 0, 0x1 },
+  { "arr_min",     fn_arr_min,     1, 0, 0, 0x1 },
+  { "arr_max",     fn_arr_max,     1, 0, 0, 0x1 },
+  { "arr_dot",     fn_arr_dot,     2, 0, 0, 0x3 },
+  { "arr_avg",     fn_arr_avg,     3, 0, 0, 0x3 },
 
   { "yield",       fn_yield,       0 },
 };
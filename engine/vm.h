@@ -1,18 +1,32 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include <atomic>
 
-#define MAX_STACK     32
+#define MAX_STACK     256    // pila única: operandos + ventanas de frame
 #define MAX_VARS      32
-#define MAX_CODE      128
-#define MAX_FUNCS     64
+// code, funcs y string_pool crecen en la arena del programa; estos son
+// los topes que impone la codificación del bytecode
+#define MAX_CODE      65535  // destinos de salto de 16 bits
+#define MAX_FUNCS     255    // operando de CALL de 1 byte (0xFF = NO_FUNC)
 #define MAX_SCOPE     32
 #define MAX_SYM       128
+#define SYM_BUCKETS   64
 #define MAX_STRING    64
-#define MAX_ARRAY     16
 #define MAX_PARAM     8
-#define MAX_STR_POOL  16
-#define MAX_FRAMES    32
+#define MAX_STR_POOL  256    // operando de PUSH_STR de 1 byte
+#define MAX_FRAMES    8      // anidamiento de func en compilación
+#define MAX_FOR_STEP  64     // bytes de código del paso de un for
+#define MAX_CASES     64     // case pendientes (switch anidados incluidos)
+#define INLINE_MAX    32     // bytes de cuerpo de una función expandible en línea
+#define MAX_ARRAYS    16     // arrays vivos por instancia
+#define MAX_ARRAY_LEN 65535  // elementos de un array
+
+// Perfilador (minic -p): con 0 no se compila nada de él y el intérprete
+// queda exactamente igual; con 1 cada instancia puede llevar un perfil.
+#ifndef MINIC_PROFILE
+#define MINIC_PROFILE 0
+#endif
 
 // ---------------- Tipos -----------------
 
@@ -23,28 +37,48 @@ typedef enum {
   T_I32,
   T_BOOL,
   T_STRING,
-  T_ARRAY
+  T_ARRAY,
+  T_ANY      // solo en compilación: tipo no deducible estáticamente
 } ValueType;
 
+// Valor compacto: una palabra de 32 bits más la etiqueta de tipo (8 bytes).
+// Los enteros (int8/int16/bool) se guardan ya extendidos en signo en i32;
+// para T_STRING / T_ARRAY i32 es un handle al heap de la VM
+// (ver Strings / Arrays), nunca una copia del contenido.
 typedef struct {
-  ValueType type;
-  union {
-    int8_t   i8;
-    int16_t  i16;
-    int32_t  i32;
-    uint8_t  boolean;
-    char     str[MAX_STRING];
-    struct {
-      int32_t array[MAX_ARRAY];
-      int length;
-    } arr;
-  };
+  int32_t i32;
+  uint8_t type;   // ValueType
 } Value;
 
+// -------- Arrays --------
+// int8[] / int16[] / int32[] de cualquier longitud, empaquetados al ancho
+// de su elemento en un bloque propio (malloc). El handle es el índice en
+// vm->arrays; como las strings, se recogen cuando ya no hay ningún
+// Value que los nombre (ver arr_collect()). Al leer un elemento sale
+// siempre como int32; al guardarlo se trunca al ancho del array.
+typedef struct {
+  void *data;        // NULL: entrada libre de vm->arrays
+  uint16_t length;
+  uint8_t type;      // T_I8, T_I16 o T_I32
+} VmArray;
+
+// -------- Strings --------
+// Inmutables. Handle < STR_DYN: literal de prog->string_pool, internado en
+// compilación (literales iguales = mismo handle) y vivo todo el programa.
+// Handle >= STR_DYN: vm->dyn[h - STR_DYN], creada en ejecución por una
+// nativa. Un trozo (str_sub) no copia: apunta a los bytes de su dueño y le
+// suma una referencia; el dueño no se libera mientras tenga trozos vivos.
+#define STR_DYN      0x100
+#define MAX_DYN_STR  32
+#define STR_NONE     0xFF   // owner: bytes propios (malloc)
+#define STR_LITERAL  0xFE   // owner: trozo de un literal
+
 typedef struct {
-    Value *items;
-    int length;
-} Array;
+  const char *ptr;   // primer byte; un trozo no termina en '\0'
+  uint16_t len;
+  uint8_t refs;      // trozos vivos sobre sus bytes
+  uint8_t owner;     // dueño de los bytes (índice en vm->dyn) o STR_NONE/STR_LITERAL
+} VmString;          // ptr == NULL: entrada libre de vm->dyn
 
 // -------- Tokens --------
 typedef enum {
@@ -55,14 +89,16 @@ typedef enum {
   TK_EQ, TK_NE, TK_LT, TK_LE, TK_GT, TK_GE,
   TK_AND, TK_OR, TK_NOT,
   TK_NAND, TK_NOR, TK_XOR, TK_SHL, TK_SHR,
+  TK_BAND, TK_BOR,
   TK_ASSIGN, TK_ADD_ASSIGN, TK_SUB_ASSIGN, TK_MUL_ASSIGN, TK_DIV_ASSIGN, TK_MOD_ASSIGN, TK_AND_ASSIGN, TK_OR_ASSIGN, TK_XOR_ASSIGN,
   TK_LP, TK_RP,
   TK_LC, TK_RC,
   TK_LB, TK_RB,
-  TK_COMMA, TK_SEMI,
+  TK_COMMA, TK_SEMI, TK_COLON,
   KW_IF, KW_ELSE, KW_WHILE, KW_FOR,
   KW_RETURN, KW_CONST,
   KW_BREAK, KW_CONTINUE,
+  KW_SWITCH, KW_CASE, KW_DEFAULT,
   KW_INT8, KW_INT16, KW_INT32,
   KW_BOOL, KW_STRING,
   KW_VAR,
@@ -71,43 +107,124 @@ typedef enum {
 } Token;
 
 // -------- Bytecode --------
+// Lista X-macro (opcode, bytes de operando): genera el enum, la tabla de
+// despacho de vm_exec() y la longitud de cada instrucción a partir de la
+// misma fuente, así nunca se desincronizan.
+// Codificación: opcode de 1 byte + operandos little-endian. Los slots de
+// variable y los índices de función/nativa/string ocupan 1 byte, los
+// destinos de salto 2 (dirección absoluta en prog->code) y las constantes
+// usan la variante más corta que las representa (PUSH_I8/I16/CONST).
+#define MINIC_OPCODES(X) \
+  X(OP_NOP, 0) \
+  X(OP_HALT, 0) \
+  X(OP_POP, 0) \
+  X(OP_DUP, 0) \
+  X(OP_PUSH_I8, 1)            /* entero inmediato int8      */ \
+  X(OP_PUSH_I16, 2)           /* entero inmediato int16     */ \
+  X(OP_PUSH_CONST, 4)         /* entero inmediato int32     */ \
+  X(OP_PUSH_STR, 1)           /* handle de prog->string_pool */ \
+  X(OP_PUSH_GLOBAL, 1) X(OP_PUSH_LOCAL, 1) \
+  X(OP_STORE_GLOBAL, 1) X(OP_STORE_LOCAL, 1) \
+  X(OP_ARR_LOAD, 0)           /* [arr, idx] -> [valor]      */ \
+  X(OP_ARR_STORE, 0)          /* [arr, idx, valor] -> []    */ \
+  X(OP_NATIVE_CALL, 2)        /* índice, argc               */ \
+  X(OP_CALL, 1) \
+  X(OP_RET, 0) \
+  X(OP_ADD, 0) X(OP_SUB, 0) X(OP_MUL, 0) X(OP_DIV, 0) X(OP_MOD, 0) \
+  X(OP_XOR, 0) X(OP_SHL, 0) X(OP_SHR, 0) X(OP_BAND, 0) X(OP_BOR, 0) \
+  X(OP_EQ, 0) X(OP_NE, 0) X(OP_LT, 0) X(OP_GT, 0) X(OP_LE, 0) X(OP_GE, 0) \
+  X(OP_NOT, 0) X(OP_NEG, 0) \
+  X(OP_AND, 0) X(OP_OR, 0) \
+  /* aritmética con tipo estático: el compilador garantiza operandos */ \
+  /* enteros y opera sobre i32 sin despachar por etiqueta            */ \
+  X(OP_ADD_I32, 0) X(OP_SUB_I32, 0) X(OP_MUL_I32, 0) X(OP_DIV_I32, 0) \
+  X(OP_MOD_I32, 0) X(OP_BAND_I32, 0) X(OP_BOR_I32, 0) X(OP_XOR_I32, 0) \
+  X(OP_SHL_I32, 0) X(OP_SHR_I32, 0) \
+  X(OP_ADD_I8, 0) X(OP_SUB_I8, 0) X(OP_ADD_I16, 0) X(OP_SUB_I16, 0) \
+  X(OP_CAST_I8, 0) X(OP_CAST_I16, 0) X(OP_CAST_I32, 0) X(OP_CAST_BOOL, 0) \
+  X(OP_JMP, 2) \
+  X(OP_JMP_FALSE, 2) \
+  X(OP_JMP_TRUE, 2) \
+  /* superinstrucciones (solo las genera peephole()); slot con bit 7 = local */ \
+  X(OP_INC_VAR, 2)            /* slot, imm8: var += imm     */ \
+  X(OP_ADD_CONST, 1)          /* imm8: top += imm           */ \
+  X(OP_INC_VAR_I32, 2)        /* var int32 += imm8          */ \
+  X(OP_ADD_CONST_I32, 1)      /* top int32 += imm8          */ \
+  X(OP_PUSH_VAR_PUSH_VAR, 2)  /* slot, slot                 */ \
+  X(OP_EQ_JMP_FALSE, 2) X(OP_NE_JMP_FALSE, 2) \
+  X(OP_LT_JMP_FALSE, 2) X(OP_GT_JMP_FALSE, 2) \
+  X(OP_LE_JMP_FALSE, 2) X(OP_GE_JMP_FALSE, 2) \
+  /* cierre de un for contado (for_stmt()): var int32 += imm8 y salta   */ \
+  /* al cuerpo si var < límite; el destino va primero (ver op_is_jump) */ \
+  X(OP_FOR_LT_CONST, 8)       /* destino, slot, imm8, lím32 */ \
+  X(OP_FOR_LT_VAR, 5)         /* destino, slot, imm8, slot  */ \
+  /* despacho de un switch (switch_stmt()): saca el valor y salta. Sus   */ \
+  /* destinos van detrás como instrucciones OP_JMP, así peephole() los   */ \
+  /* recorre y reubica igual que cualquier salto                         */ \
+  X(OP_JMP_TABLE, 6)          /* mín32, n16; n+1 JMP: valor-mín, default */ \
+  X(OP_JMP_SEARCH, 2)         /* n16; n (PUSH_CONST k; JMP) por k, JMP default */ \
+  /* return f(...) (return_stmt()): la llamada reutiliza el frame actual */ \
+  X(OP_TAIL_CALL, 1) \
+  /* arrays (var_decl(), a[i] op= e) */ \
+  X(OP_ARR_NEW, 1)            /* tipo: [n] -> [arr]         */ \
+  X(OP_DUP2, 0)               /* [a, b] -> [a, b, a, b]     */
+
+#define MINIC_OP_ENUM(op, len) op,
+
 typedef enum {
-  OP_NOP,
-  OP_PUSH_CONST,
-  OP_PUSH_VAR,
-  OP_STORE_VAR,
-  OP_ARR_LOAD,
-  OP_ARR_STORE,
-  OP_NATIVE_CALL,
-  OP_CALL,
-  OP_RET,
-  OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
-  OP_XOR, OP_SHL, OP_SHR,
-  OP_EQ, OP_NE, OP_LT, OP_GT, OP_LE, OP_GE,
-  OP_NOT, OP_NEG,
-  OP_AND, OP_OR,
-  OP_JMP,
-  OP_JMP_FALSE,
-  OP_JMP_TRUE,
-  OP_BREAK,
-  OP_CONTINUE
+  MINIC_OPCODES(MINIC_OP_ENUM)
+  OP_COUNT
 } OpCode;
+#undef MINIC_OP_ENUM
+
 
 // -------- Function Metadata --------
 typedef struct {
   char name[32];
   int code_start;
   int param_count;
+  int local_count;                  // parámetros + locals: tamaño de su ventana
+  int max_depth;                    // operandos que llega a apilar (stack_depths())
   ValueType ret_type;
+  uint8_t param_types[MAX_PARAM];   // ValueType de cada parámetro
 } Function;
 
+// Tabla de líneas: desde `ip` el código es de la línea `line` del fuente,
+// hasta la siguiente entrada (ordenadas por ip). Una entrada por cada
+// cambio de línea entre sentencias; 0 = código sin línea (el OP_HALT final)
+typedef struct {
+  uint16_t ip;
+  uint16_t line;
+} LineEntry;
+
 // -------- Lexer --------
+// El fuente entra por `src`: o bien el texto entero en memoria, o bien
+// `window`, que se rellena desde `read` (p.ej. un File de LittleFS) a
+// medida que avanza el análisis, así la memoria de compilación no depende
+// del tamaño del fuente. Al empezar cada token quedan al menos
+// LX_LOOKAHEAD bytes por delante (o el final del fuente).
+#define LX_WINDOW     256
+#define LX_LOOKAHEAD  (MAX_STRING + 2)   // el token más largo: "string"
+
+typedef int (*MinicReader)(void *ctx, char *dst, int n);   // bytes leídos; <= 0 = fin
+typedef int (*MinicSeek)(void *ctx, uint32_t pos);         // 0 = no se pudo
+
 typedef struct {
   const char *src;
   int pos;
+  MinicReader read;   // NULL: src es el texto completo
+  MinicSeek seek;     // NULL: el lector no vuelve atrás
+  void *ctx;
+  int end;            // bytes válidos en window
+  int eof;
+  uint32_t base;      // posición en el fuente de window[0] (para errores)
+  int line;           // línea en curso, desde 1
+  char window[LX_WINDOW + 1];   // siempre terminada en '\0'
+
   Token tok;
   int32_t val;
   char id[32];
+  uint32_t id_hash;   // minic_hash(id), calculado al leerlo
   char str[MAX_STRING];
 } Lexer;
 
@@ -116,9 +233,8 @@ typedef enum {
   SYM_VAR_GLOBAL,
   SYM_VAR_LOCAL,
   SYM_PARAM,
-  SYM_FUNC,
-  SYM_NATIVE
-} SymKind;
+  SYM_FUNC
+} SymKind;   // las nativas no son símbolos: ver native_lookup()
 
 typedef struct {
   char name[32];
@@ -126,49 +242,237 @@ typedef struct {
   SymKind kind;
   int index; // vars/frame index
   int scope_level;
+  uint32_t hash;   // minic_hash(name)
+  int16_t next;    // siguiente símbolo de la misma cubeta (-1 = fin)
 } Symbol;
 
 typedef struct {
   Symbol table[MAX_SYM];
+  int16_t bucket[SYM_BUCKETS];   // índice + 1 del símbolo más reciente; 0 = vacía
   int count;
   int scope_level;
-  int global_count;
+  int hide_from, hide_to;   // [desde, hasta): no visibles (ver compile_lazy())
 } SymTable;
 
 // -------- Frame --------
+// Función que se está compilando (cc->frames[cc->fp]); en ejecución no hay
+// frames aparte: cada llamada es una ventana sobre vm->stack
+//   [params | locals | registro de retorno | operandos...]
+// donde los parámetros son los argumentos que dejó el llamador, sin copiar.
 typedef struct {
-  Value locals[MAX_VARS];
   int local_count;
   int param_count;
-  int ret_sp;
-  int ret_ip;
   int func_index;
-  int loop_start;
-  int loop_end;
+  uint8_t inline_slot[MAX_PARAM];   // locals ocultos para los parámetros
+  int inline_slots;                 // de las funciones expandidas en línea
 } Frame;
 
-// -------- VM --------
+// Registro de retorno: un Value de la pila tras los locals, con
+//   i32  = ret_ip | bp << 16   (bp: ventana del llamador en vm->stack)
+//   type = función del llamador; NO_FUNC = nivel superior
+// Se empaqueta en los campos del Value para que CALL/RET no pasen por memcpy.
+#define NO_FUNC 0xFF
+
+// -------- Arena --------
+// Memoria de un programa compilado (code, funcs, strings): se pide en
+// bloques de ARENA_CHUNK y se libera entera con el programa.
+#define ARENA_CHUNK 1024
+#define ARENA_ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t size;
+  size_t used;
+} ArenaChunk;   // seguido de `size` bytes de datos
+
 typedef struct {
-  Value globals[MAX_VARS];
+  ArenaChunk *head;   // bloque actual; los anteriores cuelgan de next
+  size_t total;       // bytes pedidos a malloc
+} Arena;
 
-  Value stack[MAX_STACK];
-  int sp;
+// -------- Programa --------
+// Resultado de compilar (o de cargar un .mcb): no cambia después, así que
+// lo comparten todas las instancias que lo ejecutan. code empieza por la
+// inicialización de los globals y termina siempre en OP_HALT.
+typedef struct {
+  Arena arena;
 
-  uint32_t code[MAX_CODE];
+  uint8_t *code;
   int code_size;
+  int code_cap;
+
+  Function *funcs;
+  int func_count;
+  int func_cap;
+
+  VmString *string_pool;   // literales
+  int string_count;
+  int string_cap;
+
+  LineEntry *lines;        // ip -> línea (perfil por muestreo)
+  int line_count;
+  int line_cap;
+
+  int global_count;
+  uint8_t global_types[MAX_VARS];      // ValueType inicial de cada global
+  const char *global_names[MAX_VARS];  // en la arena (minic_global)
+} MinicProgram;
+
+// Función en compilación (cc->fn[i], paralelo a prog->funcs)
+enum { FN_COMPILED, FN_LAZY, FN_CALLED };   // FN_LAZY: cuerpo sin compilar
+typedef struct {
+  uint32_t src;         // posición del '(' en el fuente
+  uint16_t line;        // y su línea
+  uint16_t begin, end;  // su código, con el salto que lo rodea: [begin, end)
+  uint8_t state;
+  uint8_t inline_len;   // bytes del cuerpo si es expandible; 0 si no
+  uint8_t syms;         // símbolos que había al declararla (los que ve)
+} FuncInfo;
+
+// case de un switch en compilación: valor y comienzo de su código
+typedef struct {
+  int32_t value;
   int ip;
+} SwitchCase;
 
+// -------- Compilador --------
+// Estado que solo existe mientras se compila (se libera al terminar)
+typedef struct {
   Frame frames[MAX_FRAMES];
   int fp;
+  SymTable sym;
+  int line;   // línea de la sentencia que se está compilando
+  SwitchCase cases[MAX_CASES];   // pila: cada switch usa los suyos del final
+  int case_count;
+  FuncInfo fn[MAX_FUNCS];
+  int last_call;                  // posición del último OP_CALL emitido
+} Compiler;
 
-  Function funcs[MAX_FUNCS];
-  int func_count;
+// -------- VM --------
+// Instancia en ejecución de un programa: cada una tiene sus globals, su
+// pila y sus strings, así que varias pueden convivir sobre el mismo
+// programa (o sobre programas distintos).
+typedef struct {
+  const MinicProgram *prog;
 
-  const char *string_pool[MAX_STR_POOL];
-  int string_count;
+  Value globals[MAX_VARS];
 
-  SymTable sym;
+  Value stack[MAX_STACK];
+  int sp;
+  int bp;     // ventana de la función en curso
+  int func;   // función en curso; NO_FUNC = nivel superior
+  int ip;
+  int fault;  // error en ejecución: la llamada en curso se abandonó
+
+  uint8_t sched;      // la ejecuta el planificador: sleep() cede en vez de bloquear
+  uint8_t core1;      // corre en el núcleo 1: las nativas core0 van por cola
+  uint8_t yield;      // yield()/sleep() pedido: vm_exec() cede tras la nativa
+  uint32_t wake_ms;   // sleep() pendiente: no vuelve a correr antes de millis() == wake_ms
+#if MINIC_PROFILE
+  struct MinicProfile *prof;   // NULL = sin perfilar
+#endif
+
+  VmString dyn[MAX_DYN_STR];   // strings de ejecución
+
+  VmArray arrays[MAX_ARRAYS];  // arrays de ejecución
 } MiniCVM;
 
+#if MINIC_PROFILE
+// -------- Perfil --------
+// Dos modos:
+//  - exacto: ciclos (ns en Linux) y ejecuciones por opcode; llamadas y
+//    tiempo por función: exclusivo (sus propias instrucciones) e inclusivo
+//    (desde la llamada hasta su RET, contando solo la activación más
+//    externa si es recursiva).
+//  - muestreo: un temporizador marca `sample` cada period_us y la VM, en
+//    el siguiente dispatch, apunta su ip en la entrada de la tabla de
+//    líneas que lo contiene. Mucho más barato; da un histograma por línea.
+#define PROF_DEPTH      64     // llamadas anidadas con inclusivo medido
+#define PROF_SAMPLE_US  1000   // periodo de muestreo por defecto
+
+typedef struct {
+  uint32_t calls;
+  uint32_t active;   // activaciones en curso
+  uint64_t incl;
+  uint64_t excl;
+} ProfFunc;
+
+typedef struct MinicProfile {
+  uint32_t op_count[OP_COUNT];
+  uint64_t op_cycles[OP_COUNT];
+  uint64_t clock;       // ciclos contados hasta ahora
+  uint32_t last;        // lectura del contador al empezar `op`
+  uint8_t op;           // opcode en curso
+  int fn_cur;           // función en curso (índice en fn)
+  int depth;
+  uint64_t enter[PROF_DEPTH];   // `clock` al entrar en cada llamada
+  const MinicProgram *prog;
+  uint32_t period_us;   // 0 = exacto; si no, muestreo
+  std::atomic<uint8_t> sample;   // lo pone el temporizador (otro hilo en Linux); lo baja la VM
+  uint32_t samples;
+  uint32_t *hits;       // muestras por entrada de prog->lines (tras fn)
+  int nfn;              // func_count + 1: la última es el nivel superior
+  ProfFunc fn[];
+} MinicProfile;
+#endif
+
+// Perfil pedido al lanzar un programa (sched_spawn(), core1_start())
+enum { PROF_OFF, PROF_EXACT, PROF_SAMPLE };
+
+// Resultado de vm_exec(): un turno acaba en OP_HALT, cediendo la CPU
+// (yield()/sleep() o ticks agotados) o con un error
+enum { VM_HALTED, VM_YIELDED, VM_PREEMPTED, VM_FAULTED };
+#define VM_UNLIMITED  INT32_MAX   // ticks: sin límite (API y ejecución directa)
+
+// Núcleo que ejecuta el código: 0 o 1 (ver core1.c). En Linux un hilo
+// hace de núcleo 1.
+#if defined(ARDUINO_ARCH_RP2040)
+#include "pico/stdlib.h"
+#define minic_core() ((int)get_core_num())
+#else
+extern thread_local int minic_core_id;
+#define minic_core() minic_core_id
+#endif
+
 extern Lexer lx;
-extern MiniCVM vm;
+// Instancia que se está ejecutando en cada núcleo; minic_vm() es la del
+// núcleo actual (la usan las nativas) y minic_set_vm() la cambia,
+// devolviendo la anterior para restaurarla
+extern MiniCVM *vm_core[2];
+static inline MiniCVM *minic_vm(void){ return vm_core[minic_core()]; }
+static inline MiniCVM *minic_set_vm(MiniCVM *v){
+  MiniCVM **cur = &vm_core[minic_core()];
+  MiniCVM *prev = *cur;
+  *cur = v;
+  return prev;
+}
+
+// -------- API --------
+// Compilar una vez y llamar muchas:
+//   MinicProgram *p = minic_compile(src);      // NULL: error (ya mostrado)
+//   MiniCVM *v = minic_vm_new(p);              // inicializa los globals
+//   int fi = minic_func(p, "tick");
+//   minic_call(v, fi, args, argc, &ret);       // cuantas veces se quiera
+//   minic_vm_free(v); minic_program_free(p);
+MinicProgram *minic_compile(const char *src);
+MinicProgram *minic_compile_stream(MinicReader read, void *ctx, MinicSeek seek = NULL);
+void minic_program_free(MinicProgram *p);
+int minic_func(const MinicProgram *p, const char *name);   // índice; -1 si no existe (o se eliminó)
+int minic_line(const MinicProgram *p, int ip);             // línea del fuente; 0 = desconocida
+
+MiniCVM *minic_vm_new(const MinicProgram *p);
+void minic_vm_free(MiniCVM *v);
+int minic_call(MiniCVM *v, int func, const int32_t *args, int argc, int32_t *ret);  // 0 = ok
+int minic_global(const MiniCVM *v, const char *name, int32_t *value);              // 0 = ok
+
+int minic_run(const char *src);   // compila, ejecuta main y lo descarta todo
+
+#if MINIC_PROFILE
+// period_us: 0 = perfil exacto; > 0 = muestreo (uno a la vez)
+int minic_profile_start(MiniCVM *v, uint32_t period_us);   // 0 = ok; se libera con la instancia
+void minic_profile_report(const MiniCVM *v, void (*line)(const char *s, void *ctx), void *ctx);
+// Muestreo: el fuente (releído con `read`) con el % de muestras de cada
+// línea delante, como perf annotate; all = 0 solo las líneas con muestras
+void minic_profile_annotate(const MiniCVM *v, MinicReader read, void *rctx, int all,
+                            void (*line)(const char *s, void *ctx), void *ctx);
+#endif
@@ -0,0 +1,386 @@
+// -------- Banco de pruebas de MiniC en Linux --------
+// Compila el motor (engine/) contra los stubs de host/stubs y mide cada
+// script de la línea de órdenes:
+//   compilación  mejor tiempo de minic_compile() sobre el fuente en memoria
+//   código       bytes de bytecode y de arena del programa
+//   ejecución    mejor tiempo de una instancia nueva + main()
+//   (tiempos de CPU del hilo, el mejor de las repeticiones)
+//   ops/s        opcodes ejecutados (con MINIC_PROFILE, contados aparte en
+//                una pasada perfilada) entre el tiempo de ejecución
+//   memoria      pico de bytes pedidos por el motor a malloc, al compilar y
+//                al ejecutar (malloc/calloc/realloc/free van envueltos con
+//                -Wl,--wrap, ver Makefile)
+// Lo que no depende de la máquina (resultado, opcodes y bytes de código)
+// se guarda con -E y se compara con -e (bench/expected.txt, en el repo);
+// los tiempos, propios de cada máquina, se guardan con -o y se comparan
+// con -b. Se sale con 1 si algún script devuelve otro resultado, ejecuta
+// más opcodes, genera más código o va más lento que el umbral.
+#include <stdarg.h>
+#include <malloc.h>
+#include "../engine/mini_c.c"
+#include "../engine/sched.c"
+#include "../engine/core1.c"
+
+// ---------- io.h ----------
+String currentPath = "/";
+bool isWebCommand = false;
+
+void outPrint(const char* s) { fputs(s, stdout); }
+void outPrint(const String& s) { outPrint(s.c_str()); }
+void outPrintln(const char* s) { puts(s); }
+void outPrintln(const String& s) { puts(s.c_str()); }
+void outPrintf(const char* fmt, ...) {
+  va_list a;
+  va_start(a, fmt);
+  vprintf(fmt, a);
+  va_end(a);
+}
+
+// ---------- memoria ----------
+extern "C" {
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+void __real_free(void *p);
+}
+
+static size_t mem_now, mem_peak;
+
+static void mem_add(void *p) {
+  if (!p) return;
+  mem_now += malloc_usable_size(p);
+  if (mem_now > mem_peak) mem_peak = mem_now;
+}
+static void mem_sub(void *p) {
+  if (p) mem_now -= malloc_usable_size(p);
+}
+static void mem_reset(void) { mem_peak = mem_now; }
+
+extern "C" {
+void *__wrap_malloc(size_t n) {
+  void *p = __real_malloc(n);
+  mem_add(p);
+  return p;
+}
+void *__wrap_calloc(size_t n, size_t size) {
+  void *p = __real_calloc(n, size);
+  mem_add(p);
+  return p;
+}
+void *__wrap_realloc(void *p, size_t n) {
+  mem_sub(p);
+  void *q = __real_realloc(p, n);
+  mem_add(q ? q : p);   // si falla, p sigue vivo
+  return q;
+}
+void __wrap_free(void *p) {
+  mem_sub(p);
+  __real_free(p);
+}
+}
+
+// ---------- medición ----------
+#define BENCH_MIN_NS     200000000ull   // tiempo mínimo midiendo cada fase
+#define BENCH_MAX_REPS   1000
+#define BENCH_NAME       24
+
+// Tiempo de CPU del hilo: lo que el proceso pasa desalojado no cuenta
+static uint64_t bench_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+typedef struct {
+  char name[BENCH_NAME];
+  int32_t result;
+  double compile_us;
+  double run_us;
+  uint64_t ops;          // 0 = sin contar (MINIC_PROFILE 0)
+  int code;
+  size_t arena;
+  size_t compile_peak;
+  size_t run_peak;
+} BenchResult;
+
+static char *read_file(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return NULL;
+  fseek(f, 0, SEEK_END);
+  long n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *src = (char *)__real_malloc(n + 1);   // no cuenta como memoria del motor
+  if (src && fread(src, 1, n, f) != (size_t)n) {
+    __real_free(src);
+    src = NULL;
+  }
+  fclose(f);
+  if (src) src[n] = '\0';
+  *len = n;
+  return src;
+}
+
+// Instancia nueva y main(); -1 si falla
+static int run_main(const MinicProgram *p, int32_t *ret, int profile, uint64_t *ops) {
+  MiniCVM *v = minic_vm_new(p);
+  if (!v) return -1;
+#if MINIC_PROFILE
+  if (profile) minic_profile_start(v, 0);
+#endif
+  int fi = minic_func(p, "main");
+  *ret = 0;
+  int r = fi >= 0 ? minic_call(v, fi, NULL, 0, ret) : 0;
+#if MINIC_PROFILE
+  if (profile && v->prof)
+    for (int i = 0; i < OP_COUNT; i++) *ops += v->prof->op_count[i];
+#endif
+  minic_vm_free(v);
+  return r;
+}
+
+static const char *roundtrip_dir;   // -r: cada programa pasa por un .mcb
+
+// Guarda `p` como .mcb y lo vuelve a cargar en su lugar; NULL si la cache
+// no se acepta
+static MinicProgram *roundtrip(MinicProgram *p, uint32_t hash) {
+  LittleFS.root = roundtrip_dir;
+  int saved = minic_save(p, "/bench.mcb", hash);
+  minic_program_free(p);
+  p = saved ? minic_load("/bench.mcb", hash) : NULL;
+  LittleFS.remove("/bench.mcb");
+  return p;
+}
+
+static int bench_script(const char *path, BenchResult *b) {
+  size_t len;
+  char *src = read_file(path, &len);
+  if (!src) {
+    printf("%s: no se puede leer\n", path);
+    return -1;
+  }
+  const char *base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  memset(b, 0, sizeof(*b));
+  snprintf(b->name, sizeof(b->name), "%.*s", (int)strcspn(base, "."), base);
+
+  // compilación
+  MinicProgram *p = NULL;
+  uint64_t best = UINT64_MAX, spent = 0;
+  for (int i = 0; i < BENCH_MAX_REPS && spent < BENCH_MIN_NS; i++) {
+    minic_program_free(p);
+    mem_reset();
+    size_t before = mem_now;
+    uint64_t t0 = bench_ns();
+    p = minic_compile(src);
+    uint64_t t = bench_ns() - t0;
+    if (!p) break;
+    b->compile_peak = mem_peak - before;   // programa + estado del compilador
+    spent += t;
+    if (t < best) best = t;
+  }
+  uint32_t hash = minic_hash(src, len);
+  __real_free(src);
+  if (!p) {
+    printf("%s: error de compilación\n", path);
+    return -1;
+  }
+  if (roundtrip_dir && !(p = roundtrip(p, hash))) {
+    printf("%s: error de cache (.mcb rechazado al recargar)\n", path);
+    return -1;
+  }
+  b->compile_us = best / 1e3;
+  b->code = p->code_size;
+  b->arena = p->arena.total;
+
+  // ejecución
+  int ok = 1;
+#if MINIC_PROFILE
+  ok = run_main(p, &b->result, 1, &b->ops) == 0;
+#endif
+  best = UINT64_MAX;
+  spent = 0;
+  for (int i = 0; ok && i < BENCH_MAX_REPS && (i < 3 || spent < BENCH_MIN_NS); i++) {
+    mem_reset();
+    size_t before = mem_now;
+    uint64_t t0 = bench_ns();
+    ok = run_main(p, &b->result, 0, &b->ops) == 0;
+    uint64_t t = bench_ns() - t0;
+    b->run_peak = mem_peak - before;
+    spent += t;
+    if (t < best) best = t;
+  }
+  minic_program_free(p);
+  if (!ok) {
+    printf("%s: error de ejecución\n", path);
+    return -1;
+  }
+  b->run_us = best / 1e3;
+  return 0;
+}
+
+// -c1: el script corre una vez en el núcleo 1 (en Linux, el hilo de
+// core1_launch()), atendido desde aquí con core1_poll() como hace loop()
+static int core1_script(const char *path) {
+  size_t len;
+  char *src = read_file(path, &len);
+  if (!src) {
+    printf("%s: no se puede leer\n", path);
+    return -1;
+  }
+  MinicProgram *p = minic_compile(src);
+  __real_free(src);
+  if (!p) {
+    printf("%s: error de compilación\n", path);
+    return -1;
+  }
+  const char *base = strrchr(path, '/');
+  if (core1_start(base ? base + 1 : path, p, 0) < 0) {
+    printf("%s: núcleo 1 ocupado\n", path);
+    return -1;
+  }
+  int st;
+  while ((st = core1_poll()) == CORE1_BUSY) core1_wait();
+  return st == VM_HALTED ? 0 : -1;
+}
+
+// ---------- resultados ----------
+static void print_header(void) {
+  printf("%-12s %11s %7s %7s %9s %10s %11s %8s %9s %11s\n", "SCRIPT", "COMPILA us", "CODIGO", "ARENA",
+         "PICO C KB", "EJECUTA ms", "OPS", "Mops/s", "PICO E KB", "RESULTADO");
+}
+
+static void print_result(const BenchResult *b) {
+  char ops[24] = "-", rate[16] = "-";
+  if (b->ops) {
+    snprintf(ops, sizeof(ops), "%llu", (unsigned long long)b->ops);
+    snprintf(rate, sizeof(rate), "%.1f", b->ops / b->run_us);
+  }
+  printf("%-12s %11.1f %7d %7zu %9.1f %10.3f %11s %8s %9.1f %11d\n", b->name, b->compile_us, b->code, b->arena,
+         b->compile_peak / 1024.0, b->run_us / 1e3, ops, rate, b->run_peak / 1024.0, (int)b->result);
+}
+
+static int save_results(const char *path, const BenchResult *r, int n) {
+  FILE *f = fopen(path, "w");
+  if (!f) return -1;
+  for (int i = 0; i < n; i++)
+    fprintf(f, "%s %d %.1f %.1f %llu %d\n", r[i].name, (int)r[i].result, r[i].compile_us, r[i].run_us,
+            (unsigned long long)r[i].ops, r[i].code);
+  fclose(f);
+  return 0;
+}
+
+static int save_expected(const char *path, const BenchResult *r, int n) {
+  FILE *f = fopen(path, "w");
+  if (!f) return -1;
+  for (int i = 0; i < n; i++)
+    fprintf(f, "%s %d %llu %d\n", r[i].name, (int)r[i].result, (unsigned long long)r[i].ops, r[i].code);
+  fclose(f);
+  return 0;
+}
+
+// Compara con lo esperado; nº de diferencias (-1 si no se puede leer).
+// Sin MINIC_PROFILE no hay opcodes que comparar.
+static int compare_expected(const char *path, const BenchResult *r, int n) {
+  FILE *f = fopen(path, "r");
+  if (!f) return -1;
+  BenchResult b;
+  unsigned long long ops;
+  int bad = 0;
+  printf("\n%-12s %11s %11s %7s   %s\n", "SCRIPT", "RESULTADO", "OPS", "CODIGO", "");
+  while (fscanf(f, "%23s %d %llu %d", b.name, &b.result, &ops, &b.code) == 4) {
+    for (int i = 0; i < n; i++) {
+      if (strcmp(r[i].name, b.name)) continue;
+      const char *why = r[i].result != b.result             ? "RESULTADO DISTINTO"
+                        : r[i].ops && r[i].ops > ops        ? "MAS OPCODES"
+                        : r[i].code > b.code                ? "MAS CODIGO"
+                                                            : "";
+      printf("%-12s %11d %11llu %7d   %s\n", b.name, (int)r[i].result, (unsigned long long)r[i].ops, r[i].code, why);
+      if (*why) bad++;
+    }
+  }
+  fclose(f);
+  return bad;
+}
+
+// Compara los tiempos con la línea base; nº de regresiones (-1 si no se
+// puede leer)
+static int compare_results(const char *path, const BenchResult *r, int n, double slack) {
+  FILE *f = fopen(path, "r");
+  if (!f) return -1;
+  BenchResult b;
+  unsigned long long ops;
+  int bad = 0;
+  printf("\n%-12s %10s %10s %8s   %s\n", "SCRIPT", "BASE ms", "AHORA ms", "DIF", "");
+  while (fscanf(f, "%23s %d %lf %lf %llu %d", b.name, &b.result, &b.compile_us, &b.run_us, &ops, &b.code) == 6) {
+    for (int i = 0; i < n; i++) {
+      if (strcmp(r[i].name, b.name)) continue;
+      double d = 100.0 * (r[i].run_us - b.run_us) / b.run_us;
+      const char *why = d > slack ? "MAS LENTO" : "";
+      printf("%-12s %10.3f %10.3f %+7.1f%%   %s\n", b.name, b.run_us / 1e3, r[i].run_us / 1e3, d, why);
+      if (*why) bad++;
+    }
+  }
+  fclose(f);
+  return bad;
+}
+
+static void usage(void) {
+  puts("Uso: minic_bench [-O0] [-l] [-r dir] [-c1] [-E|-e esperado.txt] [-o guardar.txt] [-b base.txt] [-t umbral%] script.mc...");
+}
+
+int main(int argc, char **argv) {
+  const char *save = NULL, *baseline = NULL, *save_exp = NULL, *expected = NULL;
+  double slack = 10;
+  int first = 1, on_core1 = 0;
+  for (; first < argc && argv[first][0] == '-'; first++) {
+    if (!strcmp(argv[first], "-O0")) minic_opt = 0;
+    else if (!strcmp(argv[first], "-l")) minic_lazy = 1;
+    else if (!strcmp(argv[first], "-r") && first + 1 < argc) roundtrip_dir = argv[++first];
+    else if (!strcmp(argv[first], "-c1")) on_core1 = 1;
+    else if (!strcmp(argv[first], "-o") && first + 1 < argc) save = argv[++first];
+    else if (!strcmp(argv[first], "-b") && first + 1 < argc) baseline = argv[++first];
+    else if (!strcmp(argv[first], "-E") && first + 1 < argc) save_exp = argv[++first];
+    else if (!strcmp(argv[first], "-e") && first + 1 < argc) expected = argv[++first];
+    else if (!strcmp(argv[first], "-t") && first + 1 < argc) slack = atof(argv[++first]);
+    else {
+      usage();
+      return 2;
+    }
+  }
+  if (first >= argc) {
+    usage();
+    return 2;
+  }
+
+  int n = 0, failed = 0;
+  if (on_core1) {   // sin medir: solo que cada script acaba bien
+    core1_launch();
+    for (int i = first; i < argc; i++) failed += core1_script(argv[i]) < 0;
+    return failed ? 1 : 0;
+  }
+  BenchResult *res = (BenchResult *)__real_calloc(argc - first, sizeof(BenchResult));
+  print_header();
+  for (int i = first; i < argc; i++) {
+    if (bench_script(argv[i], &res[n]) < 0) {
+      failed++;
+      continue;
+    }
+    print_result(&res[n++]);
+  }
+  if (save && save_results(save, res, n) < 0) printf("No se puede escribir %s\n", save);
+  if (save_exp && save_expected(save_exp, res, n) < 0) printf("No se puede escribir %s\n", save_exp);
+  if (expected) {
+    int bad = compare_expected(expected, res, n);
+    if (bad < 0) printf("No se puede leer %s\n", expected);
+    else if (bad) printf("%d diferencia(s) frente a %s\n", bad, expected);
+    failed += bad != 0;
+  }
+  if (baseline) {
+    int bad = compare_results(baseline, res, n, slack);
+    if (bad < 0) printf("No se puede leer %s\n", baseline);
+    else if (bad) printf("%d regresión(es) frente a %s\n", bad, baseline);
+    failed += bad != 0;
+  }
+  __real_free(res);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+// -------- Arduino para Linux --------
+// Lo mínimo que usan engine/ e io.h para compilar el motor de MiniC fuera
+// de la placa (ver host/). Los pines no hacen nada; el tiempo es el real.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+
+static inline uint64_t host_ns(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static inline unsigned long millis(void){ return (unsigned long)(host_ns() / 1000000); }
+static inline unsigned long micros(void){ return (unsigned long)(host_ns() / 1000); }
+
+static inline void delay(unsigned long ms){
+  struct timespec t = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+  nanosleep(&t, NULL);
+}
+
+static inline void pinMode(int pin, int mode){}
+static inline void digitalWrite(int pin, int v){}
+static inline int digitalRead(int pin){ return 0; }
+static inline int analogRead(int pin){ return 0; }
+static inline void analogWrite(int pin, int v){}
+
+class String {
+  std::string s;
+public:
+  String(const char *c = ""){ s = c; }
+  unsigned length() const { return s.size(); }
+  const char *c_str() const { return s.c_str(); }
+  String &operator+=(const char *c){ s += c; return *this; }
+  String &operator+=(char c){ s += c; return *this; }
+};
+
+struct HardwareSerial {
+  void begin(unsigned long baud){}
+  size_t write(uint8_t c){ return 1; }
+  int available(void){ return 0; }
+  int read(void){ return -1; }
+};
+static HardwareSerial Serial1;
@@ -0,0 +1,50 @@
+#pragma once
+// -------- LittleFS para Linux --------
+// Las rutas de la placa (/x/y) se abren bajo LittleFS.root, un directorio
+// del host (por defecto ./fs; debe existir).
+#include <stdio.h>
+#include <Arduino.h>
+
+class File {
+  FILE *f = NULL;
+public:
+  File(FILE *fp = NULL) : f(fp) {}
+  operator bool() const { return f != NULL; }
+  int read(uint8_t *dst, size_t n){ return (int)fread(dst, 1, n, f); }
+  size_t write(const uint8_t *src, size_t n){ return fwrite(src, 1, n, f); }
+  size_t print(const char *s){ return fputs(s, f) < 0 ? 0 : strlen(s); }
+  bool seek(size_t pos){ return fseek(f, (long)pos, SEEK_SET) == 0; }
+  String readString(void){
+    String s;
+    int c;
+    while((c = fgetc(f)) != EOF) s += (char)c;
+    return s;
+  }
+  void close(void){
+    if(f) fclose(f);
+    f = NULL;
+  }
+};
+
+struct LittleFSStub {
+  const char *root = "fs";
+
+  void path(char *dst, size_t n, const char *p){ snprintf(dst, n, "%s%s%s", root, *p == '/' ? "" : "/", p); }
+  File open(const char *p, const char *mode){
+    char b[256];
+    path(b, sizeof(b), p);
+    return File(fopen(b, *mode == 'w' ? "wb" : "rb"));
+  }
+  bool exists(const char *p){
+    File f = open(p, "r");
+    bool ok = f;
+    f.close();
+    return ok;
+  }
+  bool remove(const char *p){
+    char b[256];
+    path(b, sizeof(b), p);
+    return ::remove(b) == 0;
+  }
+};
+static LittleFSStub LittleFS;
@@ -0,0 +1,9 @@
+#pragma once
+// SPI en bucle: transfer() devuelve el byte enviado
+#include <Arduino.h>
+
+struct SPIClass {
+  void begin(void){}
+  uint8_t transfer(uint8_t b){ return b; }
+};
+static SPIClass SPI;
@@ -0,0 +1,15 @@
+#pragma once
+// I2C sin dispositivos: las escrituras se aceptan, las lecturas no traen nada
+#include <Arduino.h>
+
+struct TwoWire {
+  void begin(void){}
+  void setClock(uint32_t hz){}
+  void beginTransmission(int addr){}
+  size_t write(uint8_t b){ return 1; }
+  uint8_t endTransmission(bool stop = true){ return 0; }
+  uint8_t requestFrom(int addr, int n){ return 0; }
+  int available(void){ return 0; }
+  int read(void){ return -1; }
+};
+static TwoWire Wire;
@@ -0,0 +1,3 @@
+#pragma once
+// engine/sys.h lo incluye siempre; en Linux no hace falta nada del SDK
+#include <Arduino.h>